@@ -23,6 +23,10 @@
 #include "fs.h"
 #include "buf.h"
 
+#if PGSIZE % BSIZE != 0
+#error "BSIZE must divide PGSIZE"
+#endif
+
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
@@ -37,13 +41,22 @@ void
 binit(void)
 {
   struct buf *b;
+  uchar *page;
+  int i;
 
   initlock(&bcache.lock, "bcache");
 
   // Create linked list of buffers
   bcache.head.prev = &bcache.head;
   bcache.head.next = &bcache.head;
+  page = 0;
   for(b = bcache.buf; b < bcache.buf+NBUF; b++){
+    // Block data comes from whole pages, so that a block never
+    // straddles a page boundary.
+    i = (b - bcache.buf) % (PGSIZE / BSIZE);
+    if(i == 0 && (page = kalloc()) == 0)
+      panic("binit");
+    b->data = page + i * BSIZE;
     b->next = bcache.head.next;
     b->prev = &bcache.head;
     initsleeplock(&b->lock, "buffer");
@@ -102,6 +115,18 @@ bread(uint dev, uint blockno)
   return b;
 }
 
+// Return a locked buf for a block whose contents the caller
+// is about to overwrite entirely, without reading it from disk.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  b->valid = 1;
+  return b;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -0,0 +1,182 @@
+// Name cache.
+//
+// The name cache remembers the results of recent directory
+// lookups, keyed by (dev, directory i-number, name): the
+// i-number the name refers to, or 0 if the directory has no
+// such entry (a negative entry). A hit lets namex() step from
+// a directory to the next path element without locking the
+// directory or reading its blocks.
+//
+// Interface:
+// * dcget() returns the cached inode for a name, with a new
+//   reference, or reports a negative or missing entry.
+// * dcenter() records the result of a lookup or a change to a
+//   directory. Callers must hold the directory's ip->lock, at
+//   least shared, so that entries cannot race with dirlink()
+//   and dirunlink(), which hold it exclusively.
+// * dcpurge() forgets every entry under a directory that is
+//   being freed, since its i-number may be reused.
+//
+// Entries live on hash chains and on an LRU list, both
+// protected by dcache.lock; the least recently used entry is
+// recycled when the cache is full.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+
+#define NDHASH 61
+
+struct dentry {
+  uint dev;
+  uint dir;              // i-number of the directory
+  uint inum;             // i-number of name, or 0 if absent
+  char name[DIRSIZ];
+  struct dentry *hnext;  // hash chain
+  struct dentry *prev;   // LRU list
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry dentry[NDCACHE];
+  struct dentry *hash[NDHASH];
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recent, head.prev is least.
+  struct dentry head;
+} dcache;
+
+void
+dcacheinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.dentry; d < dcache.dentry+NDCACHE; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+static uint
+dchash(uint dev, uint dir, char *name)
+{
+  uint h = dev * 31 + dir;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h % NDHASH;
+}
+
+// Move d to the head of the LRU list.
+static void
+dctouch(struct dentry *d)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->next = dcache.head.next;
+  d->prev = &dcache.head;
+  dcache.head.next->prev = d;
+  dcache.head.next = d;
+}
+
+// Remove d from its hash chain, if it is on one.
+static void
+dcunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  if(d->dir == 0)
+    return;
+  for(pp = &dcache.hash[dchash(d->dev, d->dir, d->name)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == d){
+      *pp = d->hnext;
+      break;
+    }
+  }
+  d->dir = 0;
+}
+
+// Caller must hold dcache.lock.
+static struct dentry*
+dcfind(uint dev, uint dir, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[dchash(dev, dir, name)]; d; d = d->hnext){
+    if(d->dev == dev && d->dir == dir && namecmp(d->name, name) == 0)
+      return d;
+  }
+  return 0;
+}
+
+// Look up name in directory dir.
+// Returns 1 on a hit, setting *ipp to the named inode with a
+// new reference, or to 0 for a negative entry.
+// Returns 0 if the cache knows nothing about name.
+int
+dcget(uint dev, uint dir, char *name, struct inode **ipp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) == 0){
+    release(&dcache.lock);
+    return 0;
+  }
+  dctouch(d);
+  // Take the reference before releasing the lock, so that a
+  // concurrent unlink cannot free the inode in between.
+  *ipp = d->inum ? iget(dev, d->inum) : 0;
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in directory dir refers to inum
+// (0 if there is no such entry).
+// Caller must hold the directory's ip->lock, at least shared.
+void
+dcenter(uint dev, uint dir, char *name, uint inum)
+{
+  struct dentry *d;
+  uint h;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dev, dir, name)) == 0){
+    // Recycle the least recently used entry.
+    d = dcache.head.prev;
+    dcunhash(d);
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+    h = dchash(dev, dir, name);
+    d->hnext = dcache.hash[h];
+    dcache.hash[h] = d;
+  }
+  d->inum = inum;
+  dctouch(d);
+  release(&dcache.lock);
+}
+
+// Forget all entries under directory dir, which is being freed.
+void
+dcpurge(uint dev, uint dir)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.dentry; d < dcache.dentry+NDCACHE; d++){
+    if(d->dev == dev && d->dir == dir)
+      dcunhash(d);
+  }
+  release(&dcache.lock);
+}
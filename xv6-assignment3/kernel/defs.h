@@ -2,6 +2,7 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct lockstat;
 struct pipe;
 struct proc;
 struct spinlock;
@@ -12,6 +13,7 @@ struct superblock;
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bnew(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
@@ -22,6 +24,12 @@ void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
 
+// dcache.c
+void            dcacheinit(void);
+int             dcget(uint, uint, char*, struct inode**);
+void            dcenter(uint, uint, char*, uint);
+void            dcpurge(uint, uint);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -36,14 +44,19 @@ int             filewrite(struct file*, uint64, int n);
 
 // fs.c
 void            fsinit(int);
+void            breclaim(void);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dirunlink(struct inode*, uint);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   iget(uint, uint);
 void            iinit();
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
+void            iunlockshared(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
@@ -52,6 +65,7 @@ struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
+int             writeimax(void);
 void            itrunc(struct inode*);
 
 // ramdisk.c
@@ -64,9 +78,16 @@ void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
 
+// lockstat.c
+void            lockstatinit(void);
+int             lockclass(int, char*);
+struct lockstat* lockcounts(int);
+int             lockstatcopyout(uint64, int);
+
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
+void            log_write_data(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
@@ -86,11 +107,14 @@ int             cpuid(void);
 void            exit(int);
 int             fork(void);
 struct proc*    find_proc_by_pid(int);
+int             find_procs_by_pid(int, int, struct proc**, struct proc**);
 int             growproc(int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+void            kickall(void);
+void            kproc(void (*)(void), char*);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
 struct cpu*     mycpu(void);
@@ -107,6 +131,24 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            preempt(void);
+int             setpriority(int, int, int);
+int             setaffinity(int, uint64);
+int             getaffinity(int);
+int             setgang(int, int);
+int             setquantum(int, int);
+void            sharegang(struct proc*, struct proc*);
+
+// prof.c
+void            profinit(void);
+void            proftick(void);
+int             profdue(void);
+void            profkernel(uint64, uint64);
+void            profuser(struct proc*);
+
+// trace.c
+void            traceinit(void);
+void            trace(int, uint64);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -123,6 +165,8 @@ void            pop_off(void);
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
 // string.c
@@ -141,11 +185,23 @@ void            argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+int             sysstatcopyout(int, uint64, int);
+void            sysstatclear(struct proc*);
+
+// timer.c
+void            hrtimerinit(void);
+int             hrtimerintr(void);
+void            hrtimerslice(uint64);
+int             hrtimerpoke(int, uint64);
+void            hrtimerprof(uint64);
+int             nanosleep(uint64);
+uint64          clocknow(void);
 
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
+void            clockintr(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
 
@@ -91,9 +91,9 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, &st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
@@ -118,10 +118,20 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    // The inode lock also protects f->off, so only a file
+    // that no other process can be using may be read with the
+    // lock shared.
+    if(f->ref == 1){
+      ilockshared(f->ip);
+      if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+        f->off += r;
+      iunlockshared(f->ip);
+    } else {
+      ilock(f->ip);
+      if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+        f->off += r;
+      iunlock(f->ip);
+    }
   } else {
     panic("fileread");
   }
@@ -147,12 +157,11 @@ filewrite(struct file *f, uint64 addr, int n)
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+    // the maximum log transaction size. file data goes
+    // to disk directly (ordered mode, see writei()), so
+    // only the i-node, indirect block, and allocation
+    // blocks are logged; writeimax() does the accounting.
+    int max = writeimax();
     int i = 0;
     while(i < n){
       int n1 = n - i;
@@ -18,15 +18,28 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext; // itable hash chain
+  struct inode *lprev; // itable LRU list, while ref == 0
+  struct inode *lnext;
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  struct dirindex *dindex; // T_DIR: name hash index, or 0
+  uint agoal;         // where to try to allocate the next block
+  int ndelay;         // blocks with delayed addresses
+  int dlisted;        // on delay.list? (protected by delay.lock)
+  struct inode *dnext;
+  uint disksize;      // size last written to disk; see iupdate()
 
   short type;         // copy of disk inode
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint flags;
+  union {
+    uint addrs[NDIRECT+2];
+    char data[NINLINE];
+  };
 };
 
 // map major device number to device functions.
@@ -38,3 +51,5 @@ struct devsw {
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define PROF    2
+#define TRACE   3
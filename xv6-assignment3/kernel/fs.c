@@ -11,6 +11,7 @@
 
 #include "types.h"
 #include "riscv.h"
+#include "memlayout.h"
 #include "defs.h"
 #include "param.h"
 #include "stat.h"
@@ -22,10 +23,14 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
 
+static void fsallocinit(int);
+static void iflushd(void);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -43,7 +48,11 @@ fsinit(int dev) {
   readsb(dev, &sb);
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
+  if(sb.bsize != 0 && sb.bsize != BSIZE)
+    panic("fsinit: wrong block size");
   initlog(dev, &sb);
+  fsallocinit(dev);
+  kproc(iflushd, "flushd");
 }
 
 // Zero a block.
@@ -60,29 +69,154 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
-// returns 0 if out of disk space.
-static uint
-balloc(uint dev)
+// Blocks set aside for the first writes of each new file.
+#define ALLOCWIN 16
+
+// In-memory allocation state, built by fsinit().
+// nfree[] summarizes the free bitmap, so that balloc() can
+// skip full bitmap blocks without reading them; an entry
+// only drops while its bitmap block's buf is locked.
+// A block freed by the running transaction is still referenced
+// on disk until that transaction commits, so bfree() parks it in
+// pending[] instead of counting it free, and balloc() passes it
+// over. breclaim() releases it after the commit.
+// Each file that starts allocating gets the next window of
+// ALLOCWIN blocks as its goal, so that files written at the
+// same time do not interleave their blocks.
+struct {
+  struct spinlock lock;
+  uint *nfree;     // free blocks under each bitmap block
+  uchar **pending; // per bitmap block: bits of parked blocks
+  uint npending;   // parked blocks
+  uint nbmap;      // number of bitmap blocks
+  uint datastart;  // first data block
+  uint ntotal;     // free blocks
+  uint nreserved;  // free blocks promised to delayed data
+  uint window;     // goal for the next new file
+  uint ifree;      // no free inode below this i-number
+} fsalloc;
+
+static void
+fsallocinit(int dev)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint b, bi, n;
 
-  bp = 0;
+  initlock(&fsalloc.lock, "fsalloc");
+  fsalloc.nbmap = (sb.size + BPB - 1) / BPB;
+  if(fsalloc.nbmap > PGSIZE / sizeof(uchar*) ||
+     (fsalloc.nfree = kalloc()) == 0 || (fsalloc.pending = kalloc()) == 0)
+    panic("fsallocinit");
   for(b = 0; b < sb.size; b += BPB){
+    if((fsalloc.pending[b / BPB] = kalloc()) == 0)
+      panic("fsallocinit");
+    memset(fsalloc.pending[b / BPB], 0, BSIZE);
     bp = bread(dev, BBLOCK(b, sb));
+    n = 0;
     for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
+      if((bp->data[bi/8] & (1 << (bi % 8))) == 0)
+        n++;
+    }
+    fsalloc.nfree[b / BPB] = n;
+    fsalloc.ntotal += n;
+    brelse(bp);
+  }
+  fsalloc.datastart = sb.bmapstart + fsalloc.nbmap;
+  fsalloc.window = fsalloc.datastart;
+  fsalloc.ifree = 1;
+}
+
+// Reserve a free block for delayed data.
+// Returns 0 if there is none to spare.
+static int
+freserve(void)
+{
+  int ok;
+
+  acquire(&fsalloc.lock);
+  ok = fsalloc.ntotal > fsalloc.nreserved;
+  if(ok)
+    fsalloc.nreserved++;
+  release(&fsalloc.lock);
+  return ok;
+}
+
+static void
+funreserve(void)
+{
+  acquire(&fsalloc.lock);
+  fsalloc.nreserved--;
+  release(&fsalloc.lock);
+}
+
+// Allocate a disk block: goal if it is free, else the next
+// free block after it, wrapping around at the end of the disk.
+// The block is zeroed through the log if zero is set.
+// File data blocks are not zeroed here: writei() fills them and
+// writes them to their home location itself (ordered data mode).
+// Blocks reserved by freserve() are only handed out if res is
+// set, which uses up one reservation.
+// returns 0 if out of disk space.
+static uint
+balloc(uint dev, int zero, uint goal, int res)
+{
+  uint i, bm, b, bi, n;
+  int m;
+  struct buf *bp;
+
+  // Claim one of the free blocks before searching for it.
+  acquire(&fsalloc.lock);
+  if(res){
+    fsalloc.nreserved--;
+  } else if(fsalloc.ntotal <= fsalloc.nreserved){
+    release(&fsalloc.lock);
+    printf("balloc: out of blocks\n");
+    return 0;
+  }
+  fsalloc.ntotal--;
+  release(&fsalloc.lock);
+
+  if(goal < fsalloc.datastart || goal >= sb.size)
+    goal = fsalloc.datastart;
+  bm = goal / BPB;
+  // Visit the goal's bitmap block twice, in case the only
+  // free blocks left lie before the goal.
+  for(i = 0; i <= fsalloc.nbmap; i++, bm = (bm + 1) % fsalloc.nbmap){
+    acquire(&fsalloc.lock);
+    n = fsalloc.nfree[bm];
+    release(&fsalloc.lock);
+    if(n == 0)
+      continue;
+    b = bm * BPB;
+    bp = bread(dev, sb.bmapstart + bm);
+    for(bi = (i == 0 ? goal % BPB : 0); bi < BPB && b + bi < sb.size; bi++){
+      if(bi % 8 == 0 && bp->data[bi/8] == 0xff){
+        bi += 7;  // skip a full byte
+        continue;
+      }
       m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
+      // bfree() parks blocks while holding bp, so pending[]
+      // can only be stale the other way, which is harmless.
+      if((bp->data[bi/8] & m) == 0 &&  // Is block free?
+         (fsalloc.pending[bm][bi/8] & m) == 0){
         bp->data[bi/8] |= m;  // Mark block in use.
         log_write(bp);
+        acquire(&fsalloc.lock);
+        fsalloc.nfree[bm]--;
+        release(&fsalloc.lock);
         brelse(bp);
-        bzero(dev, b + bi);
+        if(zero)
+          bzero(dev, b + bi);
         return b + bi;
       }
     }
     brelse(bp);
   }
+  acquire(&fsalloc.lock);
+  fsalloc.ntotal++;
+  if(res)
+    fsalloc.nreserved++;
+  release(&fsalloc.lock);
   printf("balloc: out of blocks\n");
   return 0;
 }
@@ -101,9 +235,42 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
+  acquire(&fsalloc.lock);
+  fsalloc.pending[b / BPB][bi/8] |= m;
+  fsalloc.npending++;
+  release(&fsalloc.lock);
   brelse(bp);
 }
 
+// Make the blocks freed by the transaction that just
+// committed available to balloc().
+// Called by commit().
+void
+breclaim(void)
+{
+  uint bm, i;
+  uchar *p;
+  int m;
+
+  acquire(&fsalloc.lock);
+  for(bm = 0; bm < fsalloc.nbmap && fsalloc.npending > 0; bm++){
+    p = fsalloc.pending[bm];
+    for(i = 0; i < BSIZE; i++){
+      if(p[i] == 0)
+        continue;
+      for(m = 1; m < 0x100; m <<= 1){
+        if(p[i] & m){
+          fsalloc.nfree[bm]++;
+          fsalloc.ntotal++;
+          fsalloc.npending--;
+        }
+      }
+      p[i] = 0;
+    }
+  }
+  release(&fsalloc.lock);
+}
+
 // Inodes.
 //
 // An inode describes a single unnamed file.
@@ -164,32 +331,247 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// Paths that only read an inode and its content (readi(),
+// stati(), dirlookup()) may lock it with ilockshared()
+// instead, so that several processes can read the same file
+// or search the same directory at once. Anything that changes
+// the inode or its content needs ilock().
+//
+// The itable is a hash table of entries carved out of pages
+// from kalloc(). It starts with room for NINODE entries and
+// grows on demand, up to a limit that scales with the amount
+// of physical memory.
+//
+// Each hash bucket has a spin-lock that protects ip->ref,
+// ip->dev, ip->inum, and ip->hnext of the entries on its
+// chain; one must hold the bucket's lock while using any of
+// those fields. An entry whose ref drops to zero stays on its
+// chain, so it can be found again without reading the disk,
+// and joins the LRU list of unreferenced entries, which
+// itable.lock protects. The least recently used entry is
+// recycled only when the table cannot grow. Lock order is
+// bucket lock, then itable.lock.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
-// dev, and inum.  One must hold ip->lock in order to
+// dev, inum, and the list links.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIBUCKET 61
+#define IPERPAGE (PGSIZE / sizeof(struct inode))
+
+struct ibucket {
+  struct spinlock lock;
+  struct inode *head;
+};
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct ibucket bucket[NIBUCKET];
+  int npage;     // pages of entries allocated so far
+  int maxpage;
+
+  // Unreferenced entries, through lprev/lnext.
+  // lru.lnext is most recently used, lru.lprev is least.
+  // Entries that hold no inode (inum 0) are kept at the tail.
+  struct inode lru;
 } itable;
 
+static int igrow(void);
+
+// Delayed allocation.
+//
+// A new data block among the first NDIRECT of a regular file
+// is not allocated on disk when it is first written. Instead
+// bmap() gives it a delayed address (one with DELAYED set,
+// which names no disk block) whose zeroed buffer stays pinned
+// in the buffer cache, and reserves a free block for it so that
+// allocation cannot fail later. readi() and writei() use the
+// buffer like any other. iupdate() writes delayed addresses to
+// disk as 0, so the on-disk inode never points at them.
+//
+// The flusher process, iflushd(), allocates blocks for each
+// inode's delayed data every FLUSHTICKS ticks, all at once so
+// that they end up next to each other, and writes them out.
+// Rewriting a block before then costs no disk I/O, and the data
+// of a file that is truncated or unlinked before then is simply
+// dropped. An inode with delayed data is held on delay.list,
+// which keeps a reference to it.
+//
+// At most NDELAY blocks are delayed at once; past that, and for
+// blocks beyond NDIRECT, bmap() allocates right away. Until
+// iflush() writes a delayed block, the size on disk stops short
+// of it (as ext4 holds back i_disksize), so a crash loses the
+// delayed data rather than leaving a hole in the file.
+
+#define DELAYED 0x80000000
+#define ISDELAYED(a) ((a) & DELAYED)
+#define FLUSHTICKS 30
+
+struct {
+  struct spinlock lock;
+  struct inode *list;  // inodes to flush, through ip->dnext
+  int nblock;          // delayed blocks in memory
+  uint next;           // next delayed address
+} delay;
+
+static uint idelay(struct inode*);
+
 void
 iinit()
 {
-  int i = 0;
-  
+  struct ibucket *b;
+
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+  initlock(&delay.lock, "delay");
+  for(b = itable.bucket; b < itable.bucket+NIBUCKET; b++)
+    initlock(&b->lock, "ibucket");
+  itable.lru.lprev = &itable.lru;
+  itable.lru.lnext = &itable.lru;
+
+  // Let the table use up to 1/64th of physical memory.
+  itable.maxpage = (PHYSTOP - KERNBASE) / PGSIZE / 64;
+  acquire(&itable.lock);
+  while(itable.npage * IPERPAGE < NINODE){
+    if(igrow() == 0)
+      panic("iinit");
+  }
+  release(&itable.lock);
+}
+
+static void dixdrop(struct inode*);
+static void dixfree(struct dirindex*);
+
+static struct ibucket*
+ibucket(uint dev, uint inum)
+{
+  return &itable.bucket[(dev * 31 + inum) % NIBUCKET];
+}
+
+// Remove ip from the LRU list.
+// Caller must hold itable.lock.
+static void
+lruremove(struct inode *ip)
+{
+  ip->lnext->lprev = ip->lprev;
+  ip->lprev->lnext = ip->lnext;
+  ip->lprev = 0;
+  ip->lnext = 0;
+}
+
+// Add ip to the LRU list: at the head if it may be
+// wanted again soon, else at the tail.
+// Caller must hold itable.lock.
+static void
+lruinsert(struct inode *ip, int recent)
+{
+  struct inode *at;
+
+  at = recent ? &itable.lru : itable.lru.lprev;
+  ip->lnext = at->lnext;
+  ip->lprev = at;
+  at->lnext->lprev = ip;
+  at->lnext = ip;
+}
+
+// Add a page of empty entries to the table.
+// Returns 0 if the table is at its limit or memory is short.
+// Caller must hold itable.lock.
+static int
+igrow(void)
+{
+  struct inode *ip;
+  int i;
+
+  if(itable.npage >= itable.maxpage || (ip = kalloc()) == 0)
+    return 0;
+  memset(ip, 0, PGSIZE);
+  itable.npage++;
+  for(i = 0; i < IPERPAGE; i++, ip++){
+    initsleeplock(&ip->lock, "inode");
+    lruinsert(ip, 0);
   }
+  return 1;
 }
 
-static struct inode* iget(uint dev, uint inum);
+// Find the entry for (dev, inum) on bucket b's chain.
+// Caller must hold b->lock.
+static struct inode*
+ifind(struct ibucket *b, uint dev, uint inum)
+{
+  struct inode *ip;
+
+  for(ip = b->head; ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum)
+      return ip;
+  }
+  return 0;
+}
+
+// Take a reference to a cached entry.
+// Caller must hold the lock of ip's bucket.
+static void
+ihold(struct inode *ip)
+{
+  if(ip->ref++ == 0){
+    acquire(&itable.lock);
+    lruremove(ip);
+    release(&itable.lock);
+  }
+}
+
+// Take an unreferenced entry off the LRU list for reuse,
+// growing the table first if the list is empty. Returns
+// the entry with inum 0, on no hash chain.
+static struct inode*
+iclaim(void)
+{
+  struct inode *ip, **pp;
+  struct ibucket *b;
+  struct dirindex *dx;
+
+  for(;;){
+    acquire(&itable.lock);
+    ip = itable.lru.lprev;
+    if(ip == &itable.lru && igrow())
+      ip = itable.lru.lprev;
+    if(ip == &itable.lru)
+      panic("iget: no inodes");
+    if(ip->inum == 0){
+      lruremove(ip);
+      release(&itable.lock);
+      return ip;
+    }
+    b = ibucket(ip->dev, ip->inum);
+    release(&itable.lock);
+
+    // The bucket lock comes first, so look again once
+    // both are held: ip may have been found by iget()
+    // or claimed by someone else in between. While ip is
+    // on the LRU list, its dev and inum cannot change.
+    acquire(&b->lock);
+    acquire(&itable.lock);
+    if(ip->lnext == 0 || ip->inum == 0 || ibucket(ip->dev, ip->inum) != b){
+      release(&itable.lock);
+      release(&b->lock);
+      continue;
+    }
+    lruremove(ip);
+    for(pp = &b->head; *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+    ip->hnext = 0;
+    ip->dev = 0;
+    ip->inum = 0;
+    dx = ip->dindex;  // the previous occupant's directory index
+    ip->dindex = 0;
+    release(&itable.lock);
+    release(&b->lock);
+
+    if(dx)
+      dixfree(dx);
+    return ip;
+  }
+}
 
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
@@ -198,11 +580,19 @@ static struct inode* iget(uint dev, uint inum);
 struct inode*
 ialloc(uint dev, short type)
 {
-  int inum;
+  int i, inum, start;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
+  // Start at the lowest i-number that may be free.
+  acquire(&fsalloc.lock);
+  start = fsalloc.ifree;
+  release(&fsalloc.lock);
+  if(start < 1 || start >= sb.ninodes)
+    start = 1;
+
+  inum = start;
+  for(i = 1; i < sb.ninodes; i++){
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
@@ -210,9 +600,15 @@ ialloc(uint dev, short type)
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
+      acquire(&fsalloc.lock);
+      if(fsalloc.ifree == start)  // unless iput() lowered it
+        fsalloc.ifree = inum + 1;
+      release(&fsalloc.lock);
       return iget(dev, inum);
     }
     brelse(bp);
+    if(++inum >= sb.ninodes)
+      inum = 1;
   }
   printf("ialloc: no inodes\n");
   return 0;
@@ -227,6 +623,18 @@ iupdate(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
+  int i;
+  uint size;
+
+  // Don't let the size on disk cover a delayed block, which is
+  // not on disk yet; it catches up in iflush().
+  size = ip->size;
+  if(ip->ndelay > 0){
+    for(i = 0; !ISDELAYED(ip->addrs[i]); i++)
+      ;
+    size = min(size, max(i*BSIZE, ip->disksize));
+  }
+  ip->disksize = size;
 
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
@@ -234,8 +642,15 @@ iupdate(struct inode *ip)
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
-  dip->size = ip->size;
-  memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
+  dip->size = size;
+  dip->flags = ip->flags;
+  memmove(dip->data, ip->data, sizeof(ip->data));
+  if(!(ip->flags & I_INLINE)){
+    for(i = 0; i < NDIRECT; i++){
+      if(ISDELAYED(dip->addrs[i]))
+        dip->addrs[i] = 0;
+    }
+  }
   log_write(bp);
   brelse(bp);
 }
@@ -243,35 +658,44 @@ iupdate(struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode*
+struct inode*
 iget(uint dev, uint inum)
 {
+  struct ibucket *b;
   struct inode *ip, *empty;
 
-  acquire(&itable.lock);
+  b = ibucket(dev, inum);
 
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&itable.lock);
-      return ip;
-    }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+  acquire(&b->lock);
+  if((ip = ifind(b, dev, inum)) != 0){
+    ihold(ip);
+    release(&b->lock);
+    return ip;
   }
+  release(&b->lock);
 
-  // Recycle an inode entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+  // Not cached; recycle an entry.
+  empty = iclaim();
 
+  acquire(&b->lock);
+  if((ip = ifind(b, dev, inum)) != 0){
+    // Another process cached it meanwhile.
+    ihold(ip);
+    release(&b->lock);
+    acquire(&itable.lock);
+    lruinsert(empty, 0);
+    release(&itable.lock);
+    return ip;
+  }
   ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&itable.lock);
+  ip->hnext = b->head;
+  b->head = ip;
+  release(&b->lock);
 
   return ip;
 }
@@ -281,9 +705,12 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ibucket *b;
+
+  b = ibucket(ip->dev, ip->inum);
+  acquire(&b->lock);
   ip->ref++;
-  release(&itable.lock);
+  release(&b->lock);
   return ip;
 }
 
@@ -308,8 +735,11 @@ ilock(struct inode *ip)
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
-    memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->disksize = dip->size;
+    ip->flags = dip->flags;
+    memmove(ip->data, dip->data, sizeof(ip->data));
     brelse(bp);
+    ip->agoal = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -326,9 +756,39 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode for reading only, shared with other
+// ilockshared() callers. Reads the inode from disk if necessary.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  for(;;){
+    acquiresleepshared(&ip->lock);
+    if(ip->valid)
+      return;
+    // Reading the inode from disk writes ip->xxx,
+    // which needs the lock exclusively.
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+  }
+}
+
+// Unlock an inode locked with ilockshared().
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode table entry can
-// be recycled.
+// If that was the last reference, the inode table entry stays
+// cached on the LRU list until it is recycled.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -336,7 +796,10 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  struct ibucket *b;
+
+  b = ibucket(ip->dev, ip->inum);
+  acquire(&b->lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -345,20 +808,34 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    release(&b->lock);
 
     itrunc(ip);
+    dixdrop(ip);
+    if(ip->type == T_DIR)
+      dcpurge(ip->dev, ip->inum);
     ip->type = 0;
     iupdate(ip);
     ip->valid = 0;
+    acquire(&fsalloc.lock);
+    if(ip->inum < fsalloc.ifree)
+      fsalloc.ifree = ip->inum;
+    release(&fsalloc.lock);
 
     releasesleep(&ip->lock);
 
-    acquire(&itable.lock);
+    acquire(&b->lock);
   }
 
   ip->ref--;
-  release(&itable.lock);
+  if(ip->ref == 0){
+    // Keep the entry cached; a freed inode is unlikely
+    // to be wanted again, so it goes to the tail.
+    acquire(&itable.lock);
+    lruinsert(ip, ip->valid);
+    release(&itable.lock);
+  }
+  release(&b->lock);
 }
 
 // Common idiom: unlock, then put.
@@ -374,7 +851,71 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The last NDINDIRECT
+// blocks are reached through the doubly-indirect block
+// ip->addrs[NDIRECT+1], which lists NINDIRECT indirect blocks.
+//
+// Small files and directories keep their content in the inode
+// itself: if I_INLINE is set in ip->flags, the first ip->size
+// bytes of ip->data[] (which overlays ip->addrs[]) are the
+// content and there are no blocks. readi() then serves data
+// straight from the inode, and writei() moves the content out
+// to a block once it grows past NINLINE bytes.
+//
+// Regular files use ordered data mode: their data blocks are
+// written straight to their home location by writei() and never
+// enter the log. Since writei() runs inside the same transaction
+// that logs the i-node and block pointers, the data reaches the
+// disk before the metadata that makes it reachable commits.
+// Directory content is metadata and stays fully journaled.
+
+// Allocate a block for ip, right after the one it allocated
+// last if possible; a file's first block goes in a fresh
+// window. res is passed on to balloc().
+// Caller must hold ip->lock.
+static uint
+iballoc(struct inode *ip, int zero, int res)
+{
+  uint addr;
+
+  if(ip->agoal == 0){
+    acquire(&fsalloc.lock);
+    ip->agoal = fsalloc.window;
+    fsalloc.window += ALLOCWIN;
+    if(fsalloc.window >= sb.size)
+      fsalloc.window = fsalloc.datastart;
+    release(&fsalloc.lock);
+  }
+  addr = balloc(ip->dev, zero, ip->agoal, res);
+  if(addr)
+    ip->agoal = addr + 1;
+  return addr;
+}
+
+// Return the block address in slot bn of indirect block ind.
+// If the slot is empty, allocate a block for it, zeroed if zero
+// is set (see balloc()).
+// returns 0 if out of disk space.
+static uint
+bmapind(struct inode *ip, uint ind, uint bn, int zero)
+{
+  uint addr, *a;
+  struct buf *bp;
+
+  bp = bread(ip->dev, ind);
+  a = (uint*)bp->data;
+  if((addr = a[bn]) == 0){
+    if(ip->agoal == 0 && bn > 0 && a[bn-1])
+      ip->agoal = a[bn-1] + 1;
+    addr = iballoc(ip, zero, 0);
+    if(addr){
+      a[bn] = addr;
+      log_write(bp);
+    }
+  }
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
@@ -382,12 +923,21 @@ iunlockput(struct inode *ip)
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
-  struct buf *bp;
+  uint addr;
+
+  if(ip->flags & I_INLINE)
+    panic("bmap: inline");
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0){
-      addr = balloc(ip->dev);
+      if(ip->type == T_FILE && (addr = idelay(ip)) != 0){
+        ip->addrs[bn] = addr;
+        return addr;
+      }
+      if(ip->agoal == 0 && bn > 0 && ip->addrs[bn-1] &&
+         !ISDELAYED(ip->addrs[bn-1]))
+        ip->agoal = ip->addrs[bn-1] + 1;
+      addr = iballoc(ip, ip->type != T_FILE, 0);
       if(addr == 0)
         return 0;
       ip->addrs[bn] = addr;
@@ -399,38 +949,262 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0){
-      addr = balloc(ip->dev);
+      addr = iballoc(ip, 1, 0);
       if(addr == 0)
         return 0;
       ip->addrs[NDIRECT] = addr;
     }
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      addr = balloc(ip->dev);
-      if(addr){
-        a[bn] = addr;
-        log_write(bp);
-      }
+    return bmapind(ip, addr, bn, ip->type != T_FILE);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load doubly-indirect block, allocating if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0){
+      addr = iballoc(ip, 1, 0);
+      if(addr == 0)
+        return 0;
+      ip->addrs[NDIRECT+1] = addr;
     }
-    brelse(bp);
-    return addr;
+    if((addr = bmapind(ip, addr, bn / NINDIRECT, 1)) == 0)
+      return 0;
+    return bmapind(ip, addr, bn % NINDIRECT, ip->type != T_FILE);
   }
 
   panic("bmap: out of range");
 }
 
+static uint
+bmapgetind(uint dev, uint ind, uint bn)
+{
+  uint addr;
+  struct buf *bp;
+
+  bp = bread(dev, ind);
+  addr = ((uint*)bp->data)[bn];
+  brelse(bp);
+  return addr;
+}
+
+// Like bmap(), but return 0 for a block that has not been
+// allocated, rather than allocating it.
+static uint
+bmapget(struct inode *ip, uint bn)
+{
+  uint addr;
+
+  if(ip->flags & I_INLINE)
+    panic("bmapget: inline");
+
+  if(bn < NDIRECT)
+    return ip->addrs[bn];
+  bn -= NDIRECT;
+
+  if(bn < NINDIRECT){
+    if((addr = ip->addrs[NDIRECT]) == 0)
+      return 0;
+    return bmapgetind(ip->dev, addr, bn);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      return 0;
+    if((addr = bmapgetind(ip->dev, addr, bn / NINDIRECT)) == 0)
+      return 0;
+    return bmapgetind(ip->dev, addr, bn % NINDIRECT);
+  }
+
+  panic("bmapget: out of range");
+}
+
+// Write back a data block of ip that the caller has modified.
+static void
+iwrite(struct inode *ip, struct buf *bp)
+{
+  if(ISDELAYED(bp->blockno))
+    return;  // stays in memory until iflush()
+  if(ip->type == T_FILE)
+    log_write_data(bp);
+  else
+    log_write(bp);
+}
+
+// Give a new data block of ip a delayed address, if there is
+// room. Returns 0 if the block must be allocated now instead.
+// Caller must hold ip->lock.
+static uint
+idelay(struct inode *ip)
+{
+  uint addr;
+  struct buf *bp;
+
+  acquire(&delay.lock);
+  if(delay.nblock >= NDELAY || freserve() == 0){
+    release(&delay.lock);
+    return 0;
+  }
+  delay.nblock++;
+  addr = DELAYED | (delay.next++ & ~DELAYED);
+  if(!ip->dlisted){
+    ip->dlisted = 1;
+    ip->dnext = delay.list;
+    delay.list = idup(ip);
+  }
+  release(&delay.lock);
+  ip->ndelay++;
+
+  bp = bnew(ip->dev, addr);
+  memset(bp->data, 0, BSIZE);
+  bpin(bp);
+  brelse(bp);
+  return addr;
+}
+
+// Release delayed block bn of ip, whose data now lives in
+// disk block addr, or 0 if it has been dropped.
+// Caller must hold ip->lock.
+static void
+iundelay(struct inode *ip, int bn, uint addr)
+{
+  struct buf *bp;
+
+  bp = bread(ip->dev, ip->addrs[bn]);
+  bp->valid = 0;
+  bunpin(bp);
+  brelse(bp);
+  if(addr == 0)
+    funreserve();
+  ip->addrs[bn] = addr;
+  ip->ndelay--;
+  acquire(&delay.lock);
+  delay.nblock--;
+  release(&delay.lock);
+}
+
+// Allocate blocks for ip's delayed data and write it to them,
+// or drop it if ip has no links left.
+// Caller must hold ip->lock, inside a transaction.
+static void
+iflush(struct inode *ip)
+{
+  int bn;
+  uint addr;
+  struct buf *bp, *nbp;
+
+  for(bn = 0; bn < NDIRECT && ip->ndelay > 0; bn++){
+    if(!ISDELAYED(ip->addrs[bn]))
+      continue;
+    addr = 0;
+    if(ip->nlink > 0){
+      if((addr = iballoc(ip, 0, 1)) == 0)
+        printf("iflush: lost a block of inode %d\n", ip->inum);
+    }
+    if(addr){
+      bp = bread(ip->dev, ip->addrs[bn]);
+      nbp = bnew(ip->dev, addr);
+      memmove(nbp->data, bp->data, BSIZE);
+      log_write_data(nbp);
+      brelse(nbp);
+      brelse(bp);
+    }
+    iundelay(ip, bn, addr);
+  }
+  iupdate(ip);
+}
+
+// The flusher process. Writes out all delayed data every
+// FLUSHTICKS ticks, or sooner once half of NDELAY is in use.
+static void
+iflushd(void)
+{
+  struct inode *ip;
+  uint ticks0;
+
+  for(;;){
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < FLUSHTICKS && delay.nblock < NDELAY/2)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+
+    for(;;){
+      acquire(&delay.lock);
+      if((ip = delay.list) != 0){
+        delay.list = ip->dnext;
+        ip->dnext = 0;
+        ip->dlisted = 0;
+      }
+      release(&delay.lock);
+      if(ip == 0)
+        break;
+
+      begin_op();
+      ilock(ip);
+      iflush(ip);
+      iunlock(ip);
+      iput(ip);
+      end_op();
+    }
+  }
+}
+
+// Move the content of an inline inode out to its first data
+// block, so that it can grow past NINLINE bytes.
+// Caller must hold ip->lock.
+// returns -1 if out of disk space.
+static int
+iexpand(struct inode *ip)
+{
+  char data[NINLINE];
+  uint addr;
+  struct buf *bp;
+
+  memmove(data, ip->data, sizeof(data));
+  memset(ip->data, 0, sizeof(ip->data));
+  ip->flags &= ~I_INLINE;
+  if(ip->size == 0)
+    return 0;
+
+  // Not a delayed block (see bmap()): the content is on disk
+  // already, and must stay there when the inode stops being
+  // inline, in this transaction.
+  if((addr = iballoc(ip, 0, 0)) == 0){
+    memmove(ip->data, data, sizeof(data));
+    ip->flags |= I_INLINE;
+    return -1;
+  }
+  ip->addrs[0] = addr;
+  bp = bread(ip->dev, addr);
+  memset(bp->data, 0, BSIZE);
+  memmove(bp->data, data, ip->size);
+  iwrite(ip, bp);
+  brelse(bp);
+  return 0;
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i, j, k;
+  struct buf *bp, *bp2;
+  uint *a, *a2;
+
+  if(ip->flags & I_INLINE){
+    // no blocks; ip->addrs[] holds content.
+    memset(ip->data, 0, sizeof(ip->data));
+    ip->flags &= ~I_INLINE;
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
 
   for(i = 0; i < NDIRECT; i++){
-    if(ip->addrs[i]){
+    if(ISDELAYED(ip->addrs[i])){
+      iundelay(ip, i, 0);
+    } else if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
       ip->addrs[i] = 0;
     }
@@ -448,12 +1222,33 @@ itrunc(struct inode *ip)
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
+    a = (uint*)bp->data;
+    for(j = 0; j < NINDIRECT; j++){
+      if(a[j] == 0)
+        continue;
+      bp2 = bread(ip->dev, a[j]);
+      a2 = (uint*)bp2->data;
+      for(k = 0; k < NINDIRECT; k++){
+        if(a2[k])
+          bfree(ip->dev, a2[k]);
+      }
+      brelse(bp2);
+      bfree(ip->dev, a[j]);
+    }
+    brelse(bp);
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
+  ip->agoal = 0;
   ip->size = 0;
   iupdate(ip);
 }
 
 // Copy stat information from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, at least shared.
 void
 stati(struct inode *ip, struct stat *st)
 {
@@ -462,10 +1257,13 @@ stati(struct inode *ip, struct stat *st)
   st->type = ip->type;
   st->nlink = ip->nlink;
   st->size = ip->size;
+  st->disksize = ip->disksize;
 }
 
+static uchar zeroes[BSIZE];  // what holes read as
+
 // Read data from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, at least shared.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
 int
@@ -479,12 +1277,24 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  if(ip->flags & I_INLINE){
+    if(either_copyout(user_dst, dst, ip->data + off, n) == -1)
+      return -1;
+    return n;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    uint addr = bmap(ip, off/BSIZE);
-    if(addr == 0)
-      break;
-    bp = bread(ip->dev, addr);
+    uint addr = bmapget(ip, off/BSIZE);
     m = min(n - tot, BSIZE - off%BSIZE);
+    if(addr == 0){
+      // a hole, which reads as zeros.
+      if(either_copyout(user_dst, dst, zeroes, m) == -1){
+        tot = -1;
+        break;
+      }
+      continue;
+    }
+    bp = bread(ip->dev, addr);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
       tot = -1;
@@ -506,6 +1316,7 @@ int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
   uint tot, m;
+  int fresh;
   struct buf *bp;
 
   if(off > ip->size || off + n < off)
@@ -513,17 +1324,43 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  // An empty file or directory starts out inline.
+  if(!(ip->flags & I_INLINE) && ip->size == 0 && ip->addrs[0] == 0 &&
+     (ip->type == T_FILE || ip->type == T_DIR))
+    ip->flags |= I_INLINE;
+
+  if(ip->flags & I_INLINE){
+    if(off + n <= NINLINE){
+      if(either_copyin(ip->data + off, user_src, src, n) == -1)
+        return 0;
+      if(off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+    if(iexpand(ip) < 0)
+      return 0;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    // balloc() did not zero a new file data block; it holds
+    // whatever was last written there. Besides blocks past the
+    // end of the file, holes (see readi()) get new blocks, and
+    // they only occur among the direct blocks.
+    fresh = off - off%BSIZE >= ip->size ||
+      (off/BSIZE < NDIRECT && ip->addrs[off/BSIZE] == 0);
     uint addr = bmap(ip, off/BSIZE);
     if(addr == 0)
       break;
     bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
+    if(ip->type == T_FILE && fresh)
+      memset(bp->data, 0, BSIZE);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
       break;
     }
-    log_write(bp);
+    iwrite(ip, bp);
     brelse(bp);
   }
 
@@ -538,6 +1375,23 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   return tot;
 }
 
+// Largest write that filewrite() may hand to writei() in a
+// single transaction. File data bypasses the log, so only the
+// i-node, the indirect blocks and the bitmap blocks count against
+// MAXOPBLOCKS. A run of at most NINDIRECT+1 blocks touches at
+// most 3 indirect blocks (the singly-indirect block or the
+// doubly-indirect block plus two of its children). Each new
+// block dirties at most one bitmap block, and never more than
+// the whole bitmap; a non-aligned write touches one block more
+// than its length suggests.
+int
+writeimax(void)
+{
+  if(sb.size/BPB + 1 > MAXOPBLOCKS-1-3)
+    return (MAXOPBLOCKS-1-3-1) * BSIZE;
+  return NINDIRECT * BSIZE;
+}
+
 // Directories
 
 int
@@ -546,17 +1400,171 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Directory index.
+//
+// Without help, dirlookup() and dirlink() scan every entry of
+// a directory. For a directory larger than a block, the first
+// lookup after the inode is loaded builds an in-memory hash
+// index of its entries, hung off dp->dindex. Entries are
+// chained by name hash, and free slots are chained separately
+// so that dirlink() finds one without a scan. Chains are kept
+// as slot numbers plus one (0 ends a chain) in pages of links
+// indexed by slot. The index is protected by dp->lock like the
+// directory content, and is freed when the inode table entry
+// is recycled. The on-disk format is unchanged; a directory
+// too large for the index, or one whose index could not be
+// allocated, falls back to scanning.
+
+#define DIX_NHASH   1024                      // hash chains
+#define DIX_PERPAGE (PGSIZE / sizeof(ushort)) // links per page
+#define DIX_NPAGE   31                        // link pages
+
+struct dirindex {
+  uint nslot;                // slots covered: dp->size / sizeof(struct dirent)
+  ushort free;               // first free slot + 1
+  ushort hash[DIX_NHASH];    // first slot + 1 of each hash chain
+  ushort *link[DIX_NPAGE];   // next slot + 1 on the same chain
+};
+
+static uint
+dixhash(char *name)
+{
+  uint h = 2166136261;
+  int i;
+
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h % DIX_NHASH;
+}
+
+static void
+dixfree(struct dirindex *dx)
+{
+  int i;
+
+  for(i = 0; i < DIX_NPAGE; i++)
+    if(dx->link[i])
+      kfree(dx->link[i]);
+  kfree(dx);
+}
+
+// Return the chain link for slot, allocating a page of links
+// if needed. Returns 0 if out of memory or slots.
+static ushort*
+dixlink(struct dirindex *dx, uint slot)
+{
+  uint pg = slot / DIX_PERPAGE;
+
+  if(pg >= DIX_NPAGE)
+    return 0;
+  if(dx->link[pg] == 0){
+    if((dx->link[pg] = kalloc()) == 0)
+      return 0;
+    memset(dx->link[pg], 0, PGSIZE);
+  }
+  return &dx->link[pg][slot % DIX_PERPAGE];
+}
+
+// Add slot to the chain whose head is *head.
+static int
+dixpush(struct dirindex *dx, ushort *head, uint slot)
+{
+  ushort *l;
+
+  if((l = dixlink(dx, slot)) == 0)
+    return -1;
+  *l = *head;
+  *head = slot + 1;
+  return 0;
+}
+
+// Remove slot from the chain whose head is *head.
+static void
+dixunchain(struct dirindex *dx, ushort *head, uint slot)
+{
+  ushort *l;
+
+  for(l = head; *l; l = dixlink(dx, *l - 1)){
+    if(*l == slot + 1){
+      *l = *dixlink(dx, slot);
+      return;
+    }
+  }
+  panic("dixunchain");
+}
+
+// Build the index of directory dp.
+// Returns 0 if dp is too big or memory is short.
+static struct dirindex*
+dixbuild(struct inode *dp)
+{
+  struct dirindex *dx;
+  struct dirent de;
+  int slot;
+
+  if(dp->size / sizeof(de) > DIX_NPAGE * DIX_PERPAGE - 1)
+    return 0;
+  if((dx = kalloc()) == 0)
+    return 0;
+  memset(dx, 0, sizeof(*dx));
+  dx->nslot = dp->size / sizeof(de);
+
+  // Walk backwards so that the lowest free slot ends up first.
+  for(slot = dx->nslot - 1; slot >= 0; slot--){
+    if(readi(dp, 0, (uint64)&de, slot*sizeof(de), sizeof(de)) != sizeof(de))
+      panic("dixbuild read");
+    if(dixpush(dx, de.inum ? &dx->hash[dixhash(de.name)] : &dx->free, slot) < 0){
+      dixfree(dx);
+      return 0;
+    }
+  }
+  return dx;
+}
+
+// Stop indexing dp, e.g. after running out of memory.
+static void
+dixdrop(struct inode *dp)
+{
+  if(dp->dindex){
+    dixfree(dp->dindex);
+    dp->dindex = 0;
+  }
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Caller must hold dp->lock, at least shared.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off, inum, s;
   struct dirent de;
+  struct dirindex *dx;
 
   if(dp->type != T_DIR)
     panic("dirlookup not DIR");
 
+  // Callers holding dp->lock shared may race to build the
+  // index; the first to publish it wins.
+  if(dp->dindex == 0 && dp->size > BSIZE && (dx = dixbuild(dp)) != 0){
+    if(!__sync_bool_compare_and_swap(&dp->dindex, 0, dx))
+      dixfree(dx);
+  }
+
+  if((dx = dp->dindex) != 0){
+    for(s = dx->hash[dixhash(name)]; s; s = *dixlink(dx, s - 1)){
+      off = (s - 1) * sizeof(de);
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlookup read");
+      if(de.inum != 0 && namecmp(name, de.name) == 0){
+        if(poff)
+          *poff = off;
+        return iget(dp->dev, de.inum);
+      }
+    }
+    return 0;
+  }
+
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -580,8 +1588,10 @@ int
 dirlink(struct inode *dp, char *name, uint inum)
 {
   int off;
+  uint slot;
   struct dirent de;
   struct inode *ip;
+  struct dirindex *dx;
 
   // Check that name is not present.
   if((ip = dirlookup(dp, name, 0)) != 0){
@@ -590,21 +1600,60 @@ dirlink(struct inode *dp, char *name, uint inum)
   }
 
   // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
-      break;
+  if((dx = dp->dindex) != 0){
+    off = (dx->free ? dx->free - 1 : dx->nslot) * sizeof(de);
+  } else {
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if(de.inum == 0)
+        break;
+    }
   }
 
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     return -1;
+  dcenter(dp->dev, dp->inum, name, inum);
+
+  if(dx){
+    slot = off / sizeof(de);
+    if(slot == dx->nslot)
+      dx->nslot++;
+    else
+      dixunchain(dx, &dx->free, slot);
+    if(dixpush(dx, &dx->hash[dixhash(name)], slot) < 0)
+      dixdrop(dp);
+  }
 
   return 0;
 }
 
+// Remove the directory entry at byte offset off of dp, as
+// found by dirlookup(). Caller must hold dp->lock.
+void
+dirunlink(struct inode *dp, uint off)
+{
+  struct dirent de;
+  struct dirindex *dx;
+  uint slot;
+
+  if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirunlink read");
+  dcenter(dp->dev, dp->inum, de.name, 0);
+  if((dx = dp->dindex) != 0){
+    slot = off / sizeof(de);
+    dixunchain(dx, &dx->hash[dixhash(de.name)], slot);
+    if(dixpush(dx, &dx->free, slot) < 0)
+      dixdrop(dp);
+  }
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("unlink: writei");
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -648,6 +1697,8 @@ skipelem(char *path, char *name)
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
 // Must be called inside a transaction since it calls iput().
+// Path elements found in the name cache (see dcache.c) are
+// resolved without locking or reading the directory.
 static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
@@ -659,21 +1710,32 @@ namex(char *path, int nameiparent, char *name)
     ip = idup(myproc()->cwd);
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    if(!(nameiparent && *path == '\0') &&
+       dcget(ip->dev, ip->inum, name, &next)){
+      // Only directories have cache entries, so ip is one.
+      iput(ip);
+      if(next == 0)
+        return 0;
+      ip = next;
+      continue;
+    }
+    ilockshared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlockshared(ip);
+      iput(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlockshared(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+    next = dirlookup(ip, name, 0);
+    dcenter(ip->dev, ip->inum, name, next ? next->inum : 0);
+    iunlockshared(ip);
+    iput(ip);
+    if(next == 0)
       return 0;
-    }
-    iunlockput(ip);
     ip = next;
   }
   if(nameiparent){
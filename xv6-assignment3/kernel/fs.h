@@ -3,7 +3,7 @@
 
 
 #define ROOTINO  1   // root i-number
-#define BSIZE 1024  // block size
+#define BSIZE 4096  // block size; one page
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
@@ -20,13 +20,22 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint bsize;        // Block size in bytes: BSIZE, or 0 from a mkfs
+                     // that predates this field
 };
 
 #define FSMAGIC 0x10203040
 
-#define NDIRECT 12
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
+
+// Bytes of content an inode can hold in place of addrs[].
+#define NINLINE 112
+
+// Inode flags
+#define I_INLINE 0x1    // content lives in the inode, not in blocks
 
 // On-disk inode structure
 struct dinode {
@@ -35,7 +44,11 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint flags;           // I_INLINE
+  union {
+    uint addrs[NDIRECT+2];   // Data block addresses
+    char data[NINLINE];      // Content, if I_INLINE
+  };
 };
 
 // Inodes per block.
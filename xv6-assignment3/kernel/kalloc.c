@@ -8,6 +8,7 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "trace.h"
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -78,5 +79,6 @@ kalloc(void)
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
+  trace(TR_KALLOC, (uint64)r);
   return (void*)r;
 }
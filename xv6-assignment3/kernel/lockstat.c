@@ -0,0 +1,103 @@
+// Lock statistics.
+//
+// Each lock class is found by name when a lock is initialized,
+// and the lock remembers its class number. lockclasses.lock is
+// itself a spin-lock with statistics; it works before
+// lockstatinit() because a zeroed spin-lock is a free one.
+// The locks of a class can be in use on several CPUs at once,
+// so each CPU counts in its own struct lockstat for the class,
+// with interrupts off, and taking a lock writes nothing that
+// other CPUs write. lockstatcopyout() adds up the CPUs'
+// counters for the lockstat() system call.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "defs.h"
+#include "lockstat.h"
+
+struct {
+  struct spinlock lock;
+  int n;
+  struct lockstat stat[NLOCKCLASS];   // kind and name of each class
+} lockclasses;
+
+static struct lockstat lockcount[NCPU][NLOCKCLASS];
+
+void
+lockstatinit(void)
+{
+  initlock(&lockclasses.lock, "lockstat");
+}
+
+// Return the number of the lock class kind/name, counting
+// from 1, or 0 if there are too many classes.
+int
+lockclass(int kind, char *name)
+{
+  struct lockstat *ls;
+  int class;
+
+  acquire(&lockclasses.lock);
+  for(ls = lockclasses.stat; ls < lockclasses.stat + lockclasses.n; ls++){
+    if(ls->kind == kind && strncmp(ls->name, name, LSNAME-1) == 0){
+      release(&lockclasses.lock);
+      return ls - lockclasses.stat + 1;
+    }
+  }
+  if(lockclasses.n == NLOCKCLASS){
+    release(&lockclasses.lock);
+    return 0;
+  }
+  ls = &lockclasses.stat[lockclasses.n++];
+  ls->kind = kind;
+  safestrcpy(ls->name, name, LSNAME);
+  class = lockclasses.n;
+  release(&lockclasses.lock);
+  return class;
+}
+
+// Return this CPU's counters for class, or 0 if class is 0.
+// Interrupts must be off.
+struct lockstat*
+lockcounts(int class)
+{
+  if(class == 0)
+    return 0;
+  return &lockcount[cpuid()][class-1];
+}
+
+// Copy the statistics of up to n lock classes to user
+// address addr. Returns the number copied, or -1.
+int
+lockstatcopyout(uint64 addr, int n)
+{
+  struct proc *p = myproc();
+  struct lockstat ls, *c;
+  int i, id;
+
+  for(i = 0; i < n; i++){
+    acquire(&lockclasses.lock);
+    if(i >= lockclasses.n){
+      release(&lockclasses.lock);
+      break;
+    }
+    ls = lockclasses.stat[i];
+    release(&lockclasses.lock);
+    for(id = 0; id < NCPU; id++){
+      c = &lockcount[id][i];
+      ls.nacquire += c->nacquire;
+      ls.ncontended += c->ncontended;
+      ls.nspin += c->nspin;
+      ls.nsleep += c->nsleep;
+      ls.spincycles += c->spincycles;
+      if(c->maxhold > ls.maxhold)
+        ls.maxhold = c->maxhold;
+    }
+    if(copyout(p->pagetable, addr + i*sizeof(ls), (char*)&ls, sizeof(ls)) < 0)
+      return -1;
+  }
+  return i;
+}
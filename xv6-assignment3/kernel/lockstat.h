@@ -0,0 +1,19 @@
+// Lock contention statistics, as returned by lockstat().
+// Locks with the same name form a class (all the "inode"
+// sleep-locks, say), whose counts are added up together.
+
+#define LS_SLEEP  1   // sleep-lock class
+#define LS_SPIN   2   // spin-lock class
+
+#define LSNAME 16
+
+struct lockstat {
+  int kind;            // LS_SLEEP or LS_SPIN
+  char name[LSNAME];   // name shared by the class's locks
+  uint64 nacquire;     // acquisitions
+  uint64 ncontended;   // acquisitions that found the lock busy
+  uint64 nspin;        // sleep-locks: contended acquisitions that never slept
+  uint64 nsleep;       // sleep-locks: times a waiter went to sleep
+  uint64 spincycles;   // spin-locks: cycles spent waiting
+  uint64 maxhold;      // spin-locks: longest hold, in cycles
+};
@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "trace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -135,6 +136,7 @@ begin_op(void)
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      trace(TR_BEGINOP, log.outstanding);
       release(&log.lock);
       break;
     }
@@ -194,11 +196,14 @@ static void
 commit()
 {
   if (log.lh.n > 0) {
+    trace(TR_COMMIT, log.lh.n);
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
     install_trans(0); // Now install writes to home locations
     log.lh.n = 0;
     write_head();    // Erase the transaction from the log
+    breclaim();      // Blocks it freed may be reused now
+    trace(TR_COMMITDONE, 0);
   }
 }
 
@@ -234,3 +239,35 @@ log_write(struct buf *b)
   release(&log.lock);
 }
 
+// Ordered data mode: write a file data block straight to its
+// home location instead of through the log. The caller is in a
+// transaction, so the block is on disk before the i-node and
+// block pointers that refer to it commit.
+//
+// A block that is already in the current transaction must stay
+// logged, or install_trans() would overwrite it with the stale
+// logged copy. (balloc() does not reuse a block freed by the
+// current transaction, so this should not come up.)
+void
+log_write_data(struct buf *b)
+{
+  int i, logged;
+
+  acquire(&log.lock);
+  if (log.outstanding < 1)
+    panic("log_write_data outside of trans");
+  logged = 0;
+  for (i = 0; i < log.lh.n; i++) {
+    if (log.lh.block[i] == b->blockno) {
+      logged = 1;
+      break;
+    }
+  }
+  release(&log.lock);
+
+  if(logged)
+    log_write(b);
+  else
+    bwrite(b);
+}
+
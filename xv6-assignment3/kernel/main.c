@@ -16,16 +16,21 @@ main()
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
+    lockstatinit();  // lock statistics
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
+    hrtimerinit();   // high-resolution timers
+    profinit();      // sampling profiler
+    traceinit();     // event tracing
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode table
+    dcacheinit();    // path name lookup cache
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
@@ -1,13 +1,19 @@
 #define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
+#define TICKHZ       10  // clock ticks per second, counted by CPU 0
+#define QUANTUM     100  // default time slice, in ms
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // initial size of the i-node table
+#define NLOCKCLASS   64  // max lock classes with statistics
+#define NSYSCALL     48  // system call numbers are below this
+#define NDCACHE     200  // size of path name lookup cache
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       2000  // size of file system in blocks
+#define NDELAY       32  // max file data blocks awaiting allocation
+#define NBUF         (MAXOPBLOCKS*3+NDELAY)  // size of disk block cache
+#define FSSIZE       6000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
@@ -4,6 +4,8 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sched.h"
+#include "trace.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
@@ -15,17 +17,119 @@ struct proc *initproc;
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// Hash table of live processes by pid, through p->pidnext,
+// so that find_proc_by_pid() need not scan proc[].
+// Protected by pid_lock. Lock order: p->lock, then pid_lock.
+#define NPIDHASH 64
+static struct proc *pidhash[NPIDHASH];
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p);
+static void runqput(struct proc *p);
+static void kick(int id);
 
 extern char trampoline[]; // trampoline.S
 
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
-// memory model when using p->parent.
+// memory model when using p->parent,
+// p->children and p->sibling.
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// Per-CPU run queues. Each CPU's scheduler() takes processes
+// from the head of its own queue, and steals from another
+// CPU's queue only when its own is empty. A process goes back
+// on the queue of the CPU it last ran on, whose cache likely
+// still holds its data.
+//
+// Each queue holds two lists. Real-time processes, SCHED_FIFO
+// and SCHED_RR, are kept in priority order and always run
+// before SCHED_FAIR ones; they are preempted only for a more
+// urgent one, or, for SCHED_RR, one as urgent once their time
+// slice is over. SCHED_FAIR processes are kept in order of
+// virtual runtime: the CPU time they have used, scaled down by
+// their weight, so that the process that is furthest behind
+// its share runs next.
+//
+// A process's time slice ends with a one-shot timer interrupt
+// (see hrtimerslice() in timer.c), and a process that has its
+// CPU to itself gets no time slice at all, so that it runs
+// without timer interrupts until another process arrives.
+//
+// Processes in the same gang (p->gang), typically ones that
+// share memory, are run at the same time where possible: while
+// one member runs, other CPUs take waiting members ahead of
+// their own fair queue, so that members do not spin waiting on
+// one that is descheduled.
+//
+// A process is on a run queue exactly when it is RUNNABLE,
+// except while it is switching away from its CPU in yield().
+// Lock order: p->lock, then a queue's lock.
+struct runq {
+  struct spinlock lock;
+  struct proc *rt;     // SCHED_FIFO and SCHED_RR, by priority, through p->rqnext
+  struct proc *fair;   // SCHED_FAIR, by vruntime
+  uint64 minvruntime;  // vruntime of the last fair process taken
+  int n;
+  int ngang;           // queued fair processes that are in a gang
+} runq[NCPU];
+
+// How far, in timer cycles of vruntime, a gang member may
+// run ahead of its queue to join the rest of its gang.
+#define GANGSLACK 3000000
+
+// Only fair processes are taken out of turn to join their
+// gang; real-time ones run by priority regardless.
+#define GANGED(p) ((p)->gang && (p)->policy == SCHED_FAIR)
+
+// Sleeping processes, hashed by channel, so that wakeup()
+// looks only at processes that may be sleeping on its channel.
+// A process enters its channel's queue in sleep() and leaves
+// it there after waking, whether by wakeup() or kill().
+// Lock order: a queue's lock, then p->lock.
+#define NSLEEPQ 61
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;   // through p->sqnext
+} sleepq[NSLEEPQ];
+
+static struct sleepq*
+sleepqhash(void *chan)
+{
+  return &sleepq[((uint64)chan >> 3) % NSLEEPQ];
+}
+
+// Bit i is set once CPU i has entered scheduler().
+static uint64 cpuonline;
+
+// Bit i is set while CPU i waits in idle() for work.
+static uint64 cpuidle;
+
+// Time slice of each class, in ms; 0 for none.
+static int quantum[] = {
+  [SCHED_FAIR] QUANTUM,
+  [SCHED_FIFO] 0,
+  [SCHED_RR]   QUANTUM,
+};
+#define SLICE(policy) ((uint64)quantum[policy] * (TIMEBASE / 1000))
+
+// Weight of each nice value, -20..19. Each step is about
+// 1.25 times the next, so one nice level is about a 10%
+// difference in CPU share.
+#define NICE0 1024
+static int niceweight[40] = {
+  /* -20 */ 88761, 71755, 56483, 46273, 36291,
+  /* -15 */ 29154, 23254, 18705, 14949, 11916,
+  /* -10 */  9548,  7620,  6100,  4904,  3906,
+  /*  -5 */  3121,  2501,  1991,  1586,  1277,
+  /*   0 */  1024,   820,   655,   526,   423,
+  /*   5 */   335,   272,   215,   172,   137,
+  /*  10 */   110,    87,    70,    56,    45,
+  /*  15 */    36,    29,    23,    18,    15,
+};
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -49,8 +153,15 @@ procinit(void)
 {
   struct proc *p;
   
+  struct runq *rq;
+  struct sleepq *q;
+  
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(rq = runq; rq < &runq[NCPU]; rq++)
+    initlock(&rq->lock, "runq");
+  for(q = sleepq; q < &sleepq[NSLEEPQ]; q++)
+    initlock(&q->lock, "sleepq");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->state = UNUSED;
@@ -102,6 +213,51 @@ allocpid()
   return pid;
 }
 
+// Enter p in the pid hash table.
+static void
+pidinsert(struct proc *p)
+{
+  struct proc **h = &pidhash[p->pid % NPIDHASH];
+
+  acquire(&pid_lock);
+  p->pidnext = *h;
+  *h = p;
+  release(&pid_lock);
+}
+
+// Remove p from the pid hash table.
+static void
+pidremove(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&pid_lock);
+  for(pp = &pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  release(&pid_lock);
+}
+
+// Return the process that had pid when we looked, unlocked.
+// It may have exited since; callers must lock it and check.
+static struct proc*
+pidlookup(int pid)
+{
+  struct proc *p;
+
+  if(pid <= 0)
+    return 0;
+  acquire(&pid_lock);
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+  release(&pid_lock);
+  return p;
+}
+
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
@@ -123,7 +279,15 @@ allocproc(void)
 
 found:
   p->pid = allocpid();
+  pidinsert(p);
   p->state = USED;
+  p->cpu = 0;
+  p->policy = SCHED_FAIR;
+  p->prio = 0;
+  p->vruntime = 0;
+  p->runtime = 0;
+  p->affinity = ~0L;
+  p->gang = 0;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -162,12 +326,18 @@ freeproc(struct proc *p)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
+  if(p->pid)
+    pidremove(p);
   p->pid = 0;
   p->parent = 0;
+  p->children = 0;
+  p->sibling = 0;
   p->name[0] = 0;
+  p->kfn = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  sysstatclear(p);
   p->state = UNUSED;
 }
 
@@ -249,8 +419,39 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
+
+  release(&p->lock);
+}
+
+// A kernel process's very first scheduling by scheduler()
+// will swtch to kprocret.
+static void
+kprocret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn();
+  panic("kproc returned");
+}
+
+// Create a process that runs fn in the kernel, such as
+// the file system's flusher. It never enters user space
+// and never exits.
+void
+kproc(void (*fn)(void), char *name)
+{
+  struct proc *p;
 
+  if((p = allocproc()) == 0)
+    panic("kproc");
+  p->kfn = fn;
+  p->context.ra = (uint64)kprocret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  setrunnable(p);
   release(&p->lock);
 }
 
@@ -316,10 +517,17 @@ fork(void)
 
   acquire(&wait_lock);
   np->parent = p;
+  np->sibling = p->children;
+  p->children = np;
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  np->cpu = p->cpu;
+  np->policy = p->policy;
+  np->prio = p->prio;
+  np->vruntime = p->vruntime;
+  np->affinity = p->affinity;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -332,12 +540,17 @@ reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  if(p->children == 0)
+    return;
+  for(pp = p->children; ; pp = pp->sibling){
+    pp->parent = initproc;
+    if(pp->sibling == 0)
+      break;
   }
+  pp->sibling = initproc->children;
+  initproc->children = p->children;
+  p->children = 0;
+  wakeup(initproc);
 }
 
 // Exit the current process.  Does not return.
@@ -390,41 +603,38 @@ exit(int status)
 int
 wait(uint64 addr)
 {
-  struct proc *pp;
-  int havekids, pid;
+  struct proc *pp, **link;
+  int pid;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
+    // Scan through our children looking for exited ones.
+    for(link = &p->children; (pp = *link) != 0; link = &pp->sibling){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      if(pp->state == ZOMBIE){
+        // Found one.
+        pid = pp->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                                sizeof(pp->xstate)) < 0) {
           release(&pp->lock);
           release(&wait_lock);
-          return pid;
+          return -1;
         }
+        *link = pp->sibling;
+        freeproc(pp);
         release(&pp->lock);
+        release(&wait_lock);
+        return pid;
       }
+      release(&pp->lock);
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || killed(p)){
+    if(p->children == 0 || killed(p)){
       release(&wait_lock);
       return -1;
     }
@@ -434,6 +644,257 @@ wait(uint64 addr)
   }
 }
 
+// Mark p RUNNABLE and put it on the run queue
+// of the CPU it last ran on.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  runqput(p);
+}
+
+// Insert p into the run queue of p->cpu, in order.
+// If p may no longer run on p->cpu, move it to the
+// least busy CPU it may run on.
+// Caller must hold p->lock.
+static void
+runqput(struct proc *p)
+{
+  struct runq *rq;
+  struct proc **pp;
+  uint64 waiting;
+  int i;
+
+  if((p->affinity & (1L << p->cpu)) == 0){
+    for(i = 0; i < NCPU; i++){
+      if((p->affinity & cpuonline & (1L << i)) == 0)
+        continue;
+      if((p->affinity & (1L << p->cpu)) == 0 || runq[i].n < runq[p->cpu].n)
+        p->cpu = i;
+    }
+  }
+  rq = &runq[p->cpu];
+
+  acquire(&rq->lock);
+  if(p->policy != SCHED_FAIR){
+    // Behind every process of the same or higher priority.
+    for(pp = &rq->rt; *pp && (*pp)->prio >= p->prio; pp = &(*pp)->rqnext)
+      ;
+  } else {
+    // A process that slept, or came from another CPU, must
+    // not be owed the time it was away: bring it up to date.
+    if(p->vruntime < rq->minvruntime)
+      p->vruntime = rq->minvruntime;
+    for(pp = &rq->fair; *pp && (*pp)->vruntime <= p->vruntime; pp = &(*pp)->rqnext)
+      ;
+  }
+  p->rqnext = *pp;
+  *pp = p;
+  rq->n++;
+  if(GANGED(p))
+    rq->ngang++;
+  release(&rq->lock);
+
+  // Wake p's CPU if it is idle. If it is running a process,
+  // make sure that process has a time slice, since it may
+  // have been running alone without one; a real-time arrival
+  // cuts it short at once, to see whether p should preempt.
+  // Also wake an idle CPU that can steal p.
+  waiting = *(volatile uint64*)&cpuidle;
+  if(waiting & (1L << p->cpu)){
+    kick(p->cpu);
+    return;
+  }
+  if(*(struct proc *volatile *)&cpus[p->cpu].proc &&
+     hrtimerpoke(p->cpu, r_time() + (p->policy == SCHED_FAIR ? SLICE(SCHED_FAIR) : 0)))
+    kick(p->cpu);
+  if(waiting & p->affinity){
+    for(i = 0; (waiting & p->affinity & (1L << i)) == 0; i++)
+      ;
+    kick(i);
+  }
+}
+
+// Send an inter-processor interrupt to CPU id, to wake it
+// from wfi or make it re-arm its timer. timervec in kernelvec.S
+// takes it, and it reaches devintr() as a supervisor software
+// interrupt.
+static void
+kick(int id)
+{
+  *(volatile uint32*)CLINT_MSIP(id) = 1;
+}
+
+// Interrupt every CPU that is running the scheduler.
+void
+kickall(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    if(*(volatile uint64*)&cpuonline & (1L << i))
+      kick(i);
+}
+
+// Is there a process on another CPU's queue that
+// CPU id could steal?
+static int
+stealable(int id)
+{
+  struct proc *p;
+  int i, found;
+
+  found = 0;
+  for(i = 0; i < NCPU && !found; i++){
+    if(i == id || *(volatile int*)&runq[i].n == 0)
+      continue;
+    acquire(&runq[i].lock);
+    for(p = runq[i].rt; p && !found; p = p->rqnext)
+      found = (p->affinity & (1L << id)) != 0;
+    for(p = runq[i].fair; p && !found; p = p->rqnext)
+      found = (p->affinity & (1L << id)) != 0;
+    release(&runq[i].lock);
+  }
+  return found;
+}
+
+// Nothing is runnable on CPU id: wait for an interrupt,
+// rather than spin. runqput() kicks an idle CPU when it
+// queues a process that the CPU could run, but it may have
+// looked at cpuidle before we set our bit; then we see its
+// process here instead, since the queues are checked again
+// only after the bit is set.
+static void
+idle(int id)
+{
+  // With interrupts off, an IPI sent after the check below
+  // stays pending, and so stops wfi from sleeping.
+  intr_off();
+  hrtimerslice(~0UL);
+  __sync_fetch_and_or(&cpuidle, 1L << id);
+  if(*(volatile int*)&runq[id].n == 0 && !stealable(id))
+    wfi();
+  __sync_fetch_and_and(&cpuidle, ~(1L << id));
+}
+
+// Take p off its run queue.
+// Returns 0 if p was not on it.
+// Caller must hold p->lock.
+static int
+runqremove(struct proc *p)
+{
+  struct runq *rq = &runq[p->cpu];
+  struct proc **pp;
+
+  acquire(&rq->lock);
+  for(pp = p->policy != SCHED_FAIR ? &rq->rt : &rq->fair; *pp; pp = &(*pp)->rqnext){
+    if(*pp == p){
+      *pp = p->rqnext;
+      p->rqnext = 0;
+      rq->n--;
+      if(GANGED(p))
+        rq->ngang--;
+      release(&rq->lock);
+      return 1;
+    }
+  }
+  release(&rq->lock);
+  return 0;
+}
+
+// Remove and return the process that CPU id should run
+// next from rq, or 0 if rq has none that may run there.
+// Every process on CPU id's own queue may run on it, so
+// only stealing has to look past the head of a list.
+static struct proc*
+runqget(struct runq *rq, int id)
+{
+  struct proc *p, **pp;
+
+  // Peek first, so idle CPUs do not keep taking
+  // the locks of empty queues.
+  if(*(volatile int*)&rq->n == 0)
+    return 0;
+
+  acquire(&rq->lock);
+  for(pp = &rq->rt; (p = *pp) != 0; pp = &p->rqnext)
+    if(p->affinity & (1L << id))
+      break;
+  if(p == 0){
+    for(pp = &rq->fair; (p = *pp) != 0; pp = &p->rqnext)
+      if(p->affinity & (1L << id))
+        break;
+    if(p && p->vruntime > rq->minvruntime)
+      rq->minvruntime = p->vruntime;
+  }
+  if(p){
+    *pp = p->rqnext;
+    rq->n--;
+    if(GANGED(p))
+      rq->ngang--;
+    p->rqnext = 0;
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Remove and return a fair process in gang from rq that may
+// run on CPU id and is not too far ahead of its queue, or 0.
+static struct proc*
+runqgang(struct runq *rq, int id, int gang)
+{
+  struct proc *p, **pp;
+
+  if(*(volatile int*)&rq->ngang == 0)
+    return 0;
+
+  acquire(&rq->lock);
+  for(pp = &rq->fair; (p = *pp) != 0; pp = &p->rqnext){
+    if(p->gang == gang && (p->affinity & (1L << id)) &&
+       p->vruntime <= rq->minvruntime + GANGSLACK){
+      *pp = p->rqnext;
+      rq->n--;
+      rq->ngang--;
+      p->rqnext = 0;
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Find a waiting member of a gang that another CPU is
+// running, for CPU id to run alongside it.
+static struct proc*
+gangpick(int id)
+{
+  struct proc *p;
+  int i, j, gang;
+
+  for(i = 0; i < NCPU; i++){
+    gang = *(volatile int*)&cpus[i].gang;
+    if(i == id || gang == 0)
+      continue;
+    for(j = 0; j < NCPU; j++)
+      if((p = runqgang(&runq[(id + j) % NCPU], id, gang)) != 0)
+        return p;
+  }
+  return 0;
+}
+
+// Charge p for the time it has just spent running.
+// Caller must hold p->lock.
+static void
+account(struct proc *p)
+{
+  uint64 delta = r_time() - p->tstart;
+
+  p->runtime += delta;
+  if(p->policy == SCHED_FAIR)
+    p->vruntime += delta * NICE0 / niceweight[p->prio + 20];
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -446,28 +907,62 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid(), i;
   
   c->proc = 0;
+  __sync_fetch_and_or(&cpuonline, 1L << id);
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
+    // Take a real-time process from our own queue, else a
+    // member of a gang running elsewhere, else the next
+    // process from our own queue, else one from another CPU's.
+    p = 0;
+    if(*(struct proc *volatile *)&runq[id].rt == 0)
+      p = gangpick(id);
+    if(p == 0)
+      p = runqget(&runq[id], id);
+    for(i = 1; p == 0 && i < NCPU; i++)
+      p = runqget(&runq[(id + i) % NCPU], id);
+    if(p == 0){
+      idle(id);
+      continue;
     }
+
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler");
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    p->cpu = id;
+    p->tstart = r_time();
+    c->proc = p;
+    c->gang = p->gang;
+
+    // Give p a time slice only if another process is waiting
+    // for this CPU. Checked after clearing the old slice, so
+    // that a process queued meanwhile is seen here or else
+    // gives p a slice itself (see runqput()).
+    hrtimerslice(~0UL);
+    if(quantum[p->policy] && *(volatile int*)&runq[id].n > 0)
+      hrtimerslice(p->tstart + SLICE(p->policy));
+    trace(TR_RUN, 0);
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    // A process that yielded is queued only now, once its
+    // vruntime includes the time it just used.
+    c->proc = 0;
+    c->gang = 0;
+    account(p);
+    if(p->state == RUNNABLE)
+      runqput(p);
+    release(&p->lock);
   }
 }
 
@@ -493,6 +988,7 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  trace(TR_SWITCH, p->state);
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
@@ -509,6 +1005,200 @@ yield(void)
   release(&p->lock);
 }
 
+// The current process's time slice is over.
+// Give up the CPU, unless the process is real time,
+// may stay on this CPU, and no process that should
+// preempt it is waiting for it.
+void
+preempt(void)
+{
+  struct proc *p = myproc();
+  struct proc *q;
+  uint64 end;
+
+  if(p->policy != SCHED_FAIR && (p->affinity & (1L << p->cpu))){
+    // An unlocked peek; a stale answer only costs a slice.
+    q = *(struct proc *volatile *)&runq[p->cpu].rt;
+    if(q == 0 || q->prio < p->prio)
+      return;
+    if(q->prio == p->prio){
+      // Only SCHED_RR makes way for an equal process,
+      // and only once it has used up its time slice.
+      if(p->policy == SCHED_FIFO)
+        return;
+      end = p->tstart + SLICE(SCHED_RR);
+      if(r_time() < end){
+        push_off();
+        hrtimerslice(end);
+        pop_off();
+        return;
+      }
+    }
+  }
+  yield();
+}
+
+// Set the time slice of a scheduling class to ms, if ms is
+// not 0, and return the old one, or -1 for a class without.
+int
+setquantum(int policy, int ms)
+{
+  int old;
+
+  if((policy != SCHED_FAIR && policy != SCHED_RR) || ms < 0)
+    return -1;
+  old = quantum[policy];
+  if(ms)
+    quantum[policy] = ms;
+  return old;
+}
+
+// Return process pid, or the caller if pid is 0, with its
+// lock held, or 0 if there is no such process or it has exited.
+static struct proc*
+findlive(int pid)
+{
+  struct proc *p;
+
+  p = find_proc_by_pid(pid ? pid : myproc()->pid);
+  if(p && p->state == ZOMBIE){
+    release(&p->lock);
+    p = 0;
+  }
+  return p;
+}
+
+// Set the scheduling policy and priority of process pid,
+// or of the caller if pid is 0. prio is a nice value for
+// SCHED_FAIR and a real-time priority for SCHED_FIFO and
+// SCHED_RR.
+int
+setpriority(int pid, int policy, int prio)
+{
+  struct proc *p;
+  int queued, weaker;
+
+  if(policy == SCHED_FAIR){
+    if(prio < -20 || prio > 19)
+      return -1;
+  } else if(policy == SCHED_FIFO || policy == SCHED_RR){
+    if(prio < 1 || prio > 99)
+      return -1;
+  } else {
+    return -1;
+  }
+
+  if((p = findlive(pid)) == 0)
+    return -1;
+  // Requeue a waiting process in its new place.
+  queued = p->state == RUNNABLE && runqremove(p);
+  weaker = p->policy != SCHED_FAIR &&
+    (policy == SCHED_FAIR || prio < p->prio);
+  p->policy = policy;
+  p->prio = prio;
+  if(queued)
+    runqput(p);
+  // A real-time process that got weaker may have to give way
+  // to one waiting for its CPU, which may take no timer
+  // interrupts while it runs: end its slice now.
+  if(weaker && p->state == RUNNING && p != myproc() &&
+     hrtimerpoke(p->cpu, r_time()))
+    kick(p->cpu);
+  release(&p->lock);
+  if(weaker && p == myproc())
+    yield();
+  return 0;
+}
+
+// Restrict process pid, or the caller if pid is 0, to the
+// CPUs in mask (bit i for CPU i). Returns -1 if no CPU in
+// mask is running.
+int
+setaffinity(int pid, uint64 mask)
+{
+  struct proc *p;
+  int queued;
+
+  mask &= cpuonline;
+  if(mask == 0)
+    return -1;
+
+  if((p = findlive(pid)) == 0)
+    return -1;
+  // runqput() moves a waiting process to an allowed CPU.
+  // A running one moves the next time it gives up its CPU,
+  // so end its slice now if it has to move; its CPU may take
+  // no timer interrupts while it runs.
+  queued = p->state == RUNNABLE && runqremove(p);
+  p->affinity = mask;
+  if(queued)
+    runqput(p);
+  if(p->state == RUNNING && p != myproc() &&
+     (mask & (1L << p->cpu)) == 0 && hrtimerpoke(p->cpu, r_time()))
+    kick(p->cpu);
+  release(&p->lock);
+  if(p == myproc() && (mask & (1L << cpuid())) == 0)
+    yield();
+  return 0;
+}
+
+// Change p's gang, keeping its run queue's count right.
+// Caller must hold p->lock.
+static void
+joingang(struct proc *p, int gang)
+{
+  int queued;
+
+  queued = p->state == RUNNABLE && runqremove(p);
+  p->gang = gang;
+  if(queued)
+    runqput(p);
+}
+
+// Put process pid, or the caller if pid is 0, in gang,
+// or in no gang if gang is 0.
+int
+setgang(int pid, int gang)
+{
+  struct proc *p;
+
+  if(gang < 0)
+    return -1;
+  if((p = findlive(pid)) == 0)
+    return -1;
+  joingang(p, gang);
+  release(&p->lock);
+  return 0;
+}
+
+// dst has mapped memory shared with src: put it in src's
+// gang, unless it already has one. If src has no gang, start
+// one named by src's pid.
+// Caller must hold both processes' locks.
+void
+sharegang(struct proc *src, struct proc *dst)
+{
+  if(src->gang == 0)
+    joingang(src, src->pid);
+  if(dst->gang == 0)
+    joingang(dst, src->gang);
+}
+
+// Return the CPUs process pid, or the caller if pid is 0,
+// may run on, or -1 if there is no such process.
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if((p = findlive(pid)) == 0)
+    return -1;
+  mask = p->affinity & cpuonline;
+  release(&p->lock);
+  return mask;
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -536,28 +1226,43 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *q = sleepqhash(chan);
+  struct proc **pp;
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // Once we are on chan's queue and hold
+  // p->lock, we can be guaranteed that we
+  // won't miss any wakeup (wakeup searches
+  // the queue and locks p->lock),
   // so it's okay to release lk.
 
+  acquire(&q->lock);
   acquire(&p->lock);  //DOC: sleeplock1
+  p->sqnext = q->head;
+  q->head = p;
   release(lk);
 
   // Go to sleep.
+  trace(TR_SLEEP, (uint64)chan);
   p->chan = chan;
   p->state = SLEEPING;
+  release(&q->lock);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // Leave the queue.
+  acquire(&q->lock);
+  for(pp = &q->head; *pp != p; pp = &(*pp)->sqnext)
+    ;
+  *pp = p->sqnext;
+  release(&q->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
@@ -566,17 +1271,21 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
+  struct sleepq *q = sleepqhash(chan);
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
+  // The queue may also hold processes sleeping on other
+  // channels, or already woken but not yet gone.
+  acquire(&q->lock);
+  for(p = q->head; p; p = p->sqnext) {
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan) {
+      trace(TR_WAKEUP, p->pid);
+      setrunnable(p);
     }
+    release(&p->lock);
   }
+  release(&q->lock);
 }
 
 // Kill the process with the given pid.
@@ -587,20 +1296,19 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  if((p = find_proc_by_pid(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
+  } else if(p->state == RUNNING && p->cpu != cpuid()){
+    // Its CPU may take no timer interrupts while it runs
+    // alone, so interrupt it to make it notice.
+    kick(p->cpu);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 void
@@ -678,22 +1386,63 @@ procdump(void)
     else
       state = "???";
     printf("%d %s %s", p->pid, state, p->name);
+    // Times are in milliseconds; the timer runs at 10 MHz.
+    if(p->policy == SCHED_FIFO)
+      printf(" fifo %d", p->prio);
+    else if(p->policy == SCHED_RR)
+      printf(" rr %d", p->prio);
+    else
+      printf(" nice %d vrt %d", p->prio, (int)(p->vruntime / 10000));
+    printf(" cpu %d", (int)(p->runtime / 10000));
     printf("\n");
   }
 }
 
+// Return the process with pid, with p->lock held so that it
+// cannot be freed while the caller uses it, or 0 if none.
 struct proc*
 find_proc_by_pid(int pid)
 {
   struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state != UNUSED && p->pid == pid) {
-      release(&p->lock);
-      return p;
-    }
+
+  if((p = pidlookup(pid)) == 0)
+    return 0;  // Not found
+  acquire(&p->lock);
+  if(p->pid != pid || p->state == UNUSED){
+    // Freed, and perhaps reused, since the lookup.
     release(&p->lock);
+    return 0;
   }
-  return 0;  // Not found
+  return p;
+}
+
+// Look up two processes, which may be the same, and return 0
+// with both locked, or -1 if either does not exist. The locks
+// are taken in proc[] order, so that two callers locking the
+// same pair cannot deadlock.
+int
+find_procs_by_pid(int pid1, int pid2, struct proc **pp1, struct proc **pp2)
+{
+  struct proc *p1, *p2;
+
+  if(pid1 == pid2){
+    *pp1 = *pp2 = find_proc_by_pid(pid1);
+    return *pp1 ? 0 : -1;
+  }
+
+  p1 = pidlookup(pid1);
+  p2 = pidlookup(pid2);
+  if(p1 == 0 || p2 == 0)
+    return -1;
+  acquire(p1 < p2 ? &p1->lock : &p2->lock);
+  acquire(p1 < p2 ? &p2->lock : &p1->lock);
+  if(p1->pid != pid1 || p1->state == UNUSED ||
+     p2->pid != pid2 || p2->state == UNUSED){
+    release(&p1->lock);
+    release(&p2->lock);
+    return -1;
+  }
+  *pp1 = p1;
+  *pp2 = p2;
+  return 0;
 }
@@ -25,6 +25,7 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int gang;                   // Gang of the process running on this cpu, or 0.
 };
 
 extern struct cpu cpus[NCPU];
@@ -89,12 +90,25 @@ struct proc {
   // p->lock must be held when using these:
   enum procstate state;        // Process state
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *sqnext;         // Sleep queue link (protected by the queue's lock)
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  struct proc *pidnext;        // Pid hash chain (protected by pid_lock)
+  int cpu;                     // CPU it last ran on, whose run queue it uses
+  struct proc *rqnext;         // Run queue link (protected by the queue's lock)
+  int policy;                  // SCHED_FAIR or SCHED_FIFO
+  int prio;                    // Nice value, or real-time priority
+  uint64 vruntime;             // CPU time used, scaled by weight (SCHED_FAIR)
+  uint64 runtime;              // CPU time used, in timer cycles
+  uint64 tstart;               // When it last started running
+  uint64 affinity;             // CPUs it may run on, bit i for CPU i
+  int gang;                    // Gang to run alongside, or 0
 
-  // wait_lock must be held when using this:
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *children;       // First child, linked through p->sibling
+  struct proc *sibling;        // Next child of the same parent
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -105,4 +119,5 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // Kernel process: function it runs
 };
@@ -0,0 +1,205 @@
+// Sampling profiler.
+//
+// While profiling is on, each CPU's timer interrupts it every
+// 1/PROFHZ seconds (see hrtimerprof() in timer.c), and the trap
+// handler records where the CPU was: the running pid, the
+// interrupted pc, and the return addresses found by following
+// the chain of saved frame pointers, which the kernel and user
+// programs keep because they are compiled with
+// -fno-omit-frame-pointer. A RISC-V frame keeps the return
+// address at fp-8 and the caller's frame pointer at fp-16.
+//
+// Samples go into a ring per CPU, so that CPUs do not contend
+// with each other, and are read out through the prof device.
+// A full ring drops new samples until it is read.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "prof.h"
+#include "defs.h"
+
+#define NPROFSAMPLE 256             // samples per CPU
+#define PROFPOLL    10000000        // ns between looks at empty rings
+
+extern char etext[];  // kernel.ld sets this to end of kernel code.
+
+struct profring {
+  struct spinlock lock;
+  int due;                          // sample at this CPU's next trap
+  uint head, tail;                  // samples head..tail-1 are unread
+  struct profsample buf[NPROFSAMPLE];
+} profring[NCPU];
+
+static int profon;
+
+static int profread(int, uint64, int);
+static int profwrite(int, uint64, int);
+
+void
+profinit(void)
+{
+  struct profring *r;
+
+  for(r = profring; r < &profring[NCPU]; r++)
+    initlock(&r->lock, "prof");
+  devsw[PROF].read = profread;
+  devsw[PROF].write = profwrite;
+}
+
+// A sample is due on this CPU.
+// Called by hrtimerintr(), with interrupts off.
+void
+proftick(void)
+{
+  profring[cpuid()].due = 1;
+}
+
+// Return 1, once, if this CPU should take a sample.
+// Called by the trap handlers, with interrupts off.
+int
+profdue(void)
+{
+  struct profring *r = &profring[cpuid()];
+
+  if(r->due == 0)
+    return 0;
+  r->due = 0;
+  return 1;
+}
+
+static void
+profput(struct profsample *s)
+{
+  struct profring *r = &profring[s->cpu];
+
+  acquire(&r->lock);
+  if(r->tail - r->head < NPROFSAMPLE)
+    r->buf[r->tail++ % NPROFSAMPLE] = *s;
+  release(&r->lock);
+}
+
+// Sample the kernel, interrupted at pc with frame pointer fp.
+void
+profkernel(uint64 pc, uint64 fp)
+{
+  struct profsample s;
+  struct proc *p = myproc();
+  uint64 lo, hi, ra;
+
+  s.cpu = cpuid();
+  s.user = 0;
+  s.pid = p ? p->pid : 0;
+  s.pc[0] = pc;
+  s.depth = 1;
+
+  // A kernel stack is one page: stop at a frame pointer
+  // outside it, or at a return address outside the kernel's
+  // code, as in the frame usertrap() saved from user space.
+  lo = PGROUNDDOWN(fp - 16);
+  hi = lo + PGSIZE;
+  while(s.depth < PROFDEPTH && fp % 16 == 0 && fp - 16 >= lo && fp <= hi){
+    ra = *(uint64*)(fp - 8);
+    if(ra < KERNBASE || ra >= (uint64)etext)
+      break;
+    s.pc[s.depth++] = ra;
+    fp = *(uint64*)(fp - 16);
+  }
+  profput(&s);
+}
+
+// Sample process p, interrupted in user space.
+void
+profuser(struct proc *p)
+{
+  struct profsample s;
+  uint64 fp, frame[2];
+
+  s.cpu = cpuid();
+  s.user = 1;
+  s.pid = p->pid;
+  s.pc[0] = p->trapframe->epc;
+  s.depth = 1;
+
+  // Each frame is above the one it called, so stop at a frame
+  // pointer that does not go up, or that is not mapped.
+  fp = p->trapframe->s0;
+  while(s.depth < PROFDEPTH && fp % 16 == 0 && fp >= 16){
+    if(copyin(p->pagetable, (char*)frame, fp - 16, sizeof(frame)) < 0)
+      break;
+    if(frame[1] == 0)
+      break;
+    s.pc[s.depth++] = frame[1];
+    if(frame[0] <= fp)
+      break;
+    fp = frame[0];
+  }
+  profput(&s);
+}
+
+// Read whole samples. If there are none, wait for some while
+// profiling is on; return 0 once it is off and all are read.
+static int
+profread(int user_dst, uint64 dst, int n)
+{
+  struct profring *r;
+  struct profsample s;
+  int got;
+
+  if(n < sizeof(s))
+    return -1;
+  for(;;){
+    got = 0;
+    for(r = profring; r < &profring[NCPU]; r++){
+      while(n - got >= sizeof(s)){
+        acquire(&r->lock);
+        if(r->head == r->tail){
+          release(&r->lock);
+          break;
+        }
+        s = r->buf[r->head++ % NPROFSAMPLE];
+        release(&r->lock);
+        if(either_copyout(user_dst, dst + got, &s, sizeof(s)) < 0)
+          return -1;
+        got += sizeof(s);
+      }
+    }
+    if(got > 0 || *(volatile int*)&profon == 0)
+      return got;
+    if(nanosleep(PROFPOLL) < 0)
+      return -1;
+  }
+}
+
+// "1" starts profiling, discarding unread samples;
+// "0" stops it.
+static int
+profwrite(int user_src, uint64 src, int n)
+{
+  struct profring *r;
+  char c;
+
+  if(n < 1 || either_copyin(&c, user_src, src, 1) < 0)
+    return -1;
+  if(c == '1'){
+    for(r = profring; r < &profring[NCPU]; r++){
+      acquire(&r->lock);
+      r->head = r->tail;
+      release(&r->lock);
+    }
+    profon = 1;
+    hrtimerprof(TIMEBASE / PROFHZ);
+  } else if(c == '0'){
+    hrtimerprof(0);
+    profon = 0;
+  } else {
+    return -1;
+  }
+  return n;
+}
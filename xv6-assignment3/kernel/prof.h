@@ -0,0 +1,16 @@
+// Profiling samples, as read from the prof device.
+// Writing "1" to the device starts sampling every CPU
+// PROFHZ times a second; writing "0" stops it.
+
+#define PROFHZ     1000
+#define PROFDEPTH  8
+
+struct profsample {
+  uchar cpu;
+  uchar user;                // 1 if the CPU was in user space
+  uchar depth;               // entries used in pc[]
+  uchar pad;
+  int pid;                   // running process, or 0 if none
+  uint64 pc[PROFDEPTH];      // where the CPU was, then return addresses,
+                             // innermost first
+};
@@ -0,0 +1,4 @@
+// Scheduling policies, for setpriority().
+#define SCHED_FAIR  0   // weighted fair share; prio is a nice value, -20..19
+#define SCHED_FIFO  1   // real time, first in first out; prio is 1..99
+#define SCHED_RR    2   // real time, round robin; prio is 1..99
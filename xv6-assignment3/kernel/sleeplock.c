@@ -8,6 +8,11 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "sleeplock.h"
+#include "lockstat.h"
+
+// How many times a waiter polls a busy lock, while its holder
+// runs on another CPU, before going to sleep.
+#define SLEEPSPIN 10000
 
 void
 initsleeplock(struct sleeplock *lk, char *name)
@@ -15,18 +20,76 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->nshared = 0;
+  lk->nwaiting = 0;
+  lk->owner = 0;
   lk->pid = 0;
+  lk->class = lockclass(LS_SLEEP, name);
+}
+
+// lk is held exclusively by someone else. Sleep-locks such as
+// buffer and inode locks are often held only briefly, so if the
+// holder is running on another CPU, poll for a while instead of
+// paying for a sleep and a wakeup. Returns 1 if the lock was
+// released, or its holder stopped running, during the spin; 0 if
+// the caller should sleep.
+// Called and returns with lk->lk held.
+static int
+sleepspin(struct sleeplock *lk)
+{
+  volatile struct proc *owner = lk->owner;
+  volatile uint *locked = &lk->locked;
+  int i;
+
+  if(!lk->locked || owner == 0 || owner->state != RUNNING)
+    return 0;
+  release(&lk->lk);
+  for(i = 0; i < SLEEPSPIN; i++){
+    if(!*locked || owner->state != RUNNING)
+      break;
+  }
+  acquire(&lk->lk);
+  return i < SLEEPSPIN;
+}
+
+// Count an acquisition of lk in this CPU's statistics for
+// its class. Called with lk->lk held, so interrupts are off.
+static void
+sleepstat(struct sleeplock *lk, int contended, int nsleep)
+{
+  struct lockstat *ls;
+
+  if((ls = lockcounts(lk->class)) == 0)
+    return;
+  ls->nacquire++;
+  if(contended){
+    ls->ncontended++;
+    if(nsleep == 0)
+      ls->nspin++;
+    else
+      ls->nsleep += nsleep;
+  }
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  int contended = 0, nsleep = 0;
+
   acquire(&lk->lk);
-  while (lk->locked) {
+  lk->nwaiting++;
+  while (lk->locked || lk->nshared > 0) {
+    contended = 1;
+    if(sleepspin(lk))
+      continue;
     sleep(lk, &lk->lk);
+    nsleep++;
   }
+  lk->nwaiting--;
   lk->locked = 1;
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
+  sleepstat(lk, contended, nsleep);
   release(&lk->lk);
 }
 
@@ -35,11 +98,45 @@ releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
   wakeup(lk);
   release(&lk->lk);
 }
 
+// Acquire lk shared with other acquiresleepshared() callers,
+// but not with an acquiresleep() caller.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  int contended = 0, nsleep = 0;
+
+  acquire(&lk->lk);
+  // Also wait behind processes waiting for exclusive access,
+  // so that a stream of readers cannot starve them.
+  while (lk->locked || lk->nwaiting > 0) {
+    contended = 1;
+    if(sleepspin(lk))
+      continue;
+    sleep(lk, &lk->lk);
+    nsleep++;
+  }
+  lk->nshared++;
+  sleepstat(lk, contended, nsleep);
+  release(&lk->lk);
+}
+
+void
+releasesleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->nshared < 1)
+    panic("releasesleepshared");
+  if(--lk->nshared == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
 int
 holdingsleep(struct sleeplock *lk)
 {
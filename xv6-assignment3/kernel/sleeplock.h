@@ -1,10 +1,14 @@
 // Long-term locks for processes
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  int nshared;       // Number of shared holders
+  int nwaiting;      // Processes waiting in acquiresleep()
+  struct proc *owner; // Process holding lock exclusively
   struct spinlock lk; // spinlock protecting this sleep lock
   
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+  int class;         // Statistics class (see lockstat.c), or 0
 };
 
@@ -7,13 +7,27 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "lockstat.h"
+
+// Spin-locks are ticket locks: each acquire() takes the next
+// ticket and waits until lk->serving reaches it, so CPUs get
+// the lock in the order they asked for it, and waiters only
+// read the lock's cache line until their turn comes.
+//
+// Each lock also counts, in this CPU's statistics for its
+// class (see lockstat.c), its acquisitions, how many had to
+// wait, the cycles spent waiting, and the longest time it was
+// held. Interrupts are off while a lock is held, so the counts
+// need no atomic operations.
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->serving = 0;
   lk->cpu = 0;
+  lk->class = lockclass(LS_SPIN, name);
 }
 
 // Acquire the lock.
@@ -21,16 +35,24 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  struct lockstat *ls;
+  uint ticket;
+  uint64 t0, spin;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  // On RISC-V, sync_fetch_and_add turns into an atomic add:
+  //   amoadd.w a5, a5, (s1)
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+  spin = 0;
+  if(*(volatile uint*)&lk->serving != ticket){
+    t0 = r_time();
+    while(*(volatile uint*)&lk->serving != ticket)
+      ;
+    spin = r_time() - t0;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +62,33 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+
+  if((ls = lockcounts(lk->class)) != 0){
+    lk->tacquire = r_time();
+    ls->nacquire++;
+    if(spin){
+      ls->ncontended++;
+      ls->spincycles += spin;
+    }
+  }
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  struct lockstat *ls;
+  uint64 hold;
+
   if(!holding(lk))
     panic("release");
 
+  if((ls = lockcounts(lk->class)) != 0){
+    hold = r_time() - lk->tacquire;
+    if(hold > ls->maxhold)
+      ls->maxhold = hold;
+  }
+
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,14 +99,13 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
+  // Let the next ticket in, equivalent to lk->serving++.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
   // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  // On RISC-V, sync_fetch_and_add turns into an atomic add:
+  //   amoadd.w zero, a5, (s1)
+  __sync_fetch_and_add(&lk->serving, 1);
 
   pop_off();
 }
@@ -77,7 +116,7 @@ int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->next != lk->serving && lk->cpu == mycpu());
   return r;
 }
 
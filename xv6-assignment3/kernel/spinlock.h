@@ -1,9 +1,14 @@
 // Mutual exclusion lock.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out
+  uint serving;      // Ticket of the current holder
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+  // For statistics:
+  int class;         // Statistics class (see lockstat.c), or 0
+  uint64 tacquire;   // When the holder acquired it
 };
 
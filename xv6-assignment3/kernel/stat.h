@@ -8,4 +8,6 @@ struct stat {
   short type;  // Type of file
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
+  uint64 disksize; // Size recorded on disk; less than size
+                   // while new data awaits write-back
 };
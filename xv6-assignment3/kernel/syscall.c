@@ -5,8 +5,12 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "sysstat.h"
+#include "trace.h"
 #include "defs.h"
 
+extern struct proc proc[NPROC];
+
 // Fetch the uint64 at addr from the current process.
 int
 fetchaddr(uint64 addr, uint64 *ip)
@@ -104,10 +108,19 @@ extern uint64 sys_close(void);
 extern uint64 sys_map_shared_pages(void);
 extern uint64 sys_unmap_shared_pages(void);
 extern uint64 sys_getppid(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_setgang(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_clock_gettime(void);
+extern uint64 sys_sched_setquantum(void);
+extern uint64 sys_sysstat(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
-static uint64 (*syscalls[])(void) = {
+static uint64 (*syscalls[NSYSCALL])(void) = {
 [SYS_fork]    sys_fork,
 [SYS_exit]    sys_exit,
 [SYS_wait]    sys_wait,
@@ -132,19 +145,114 @@ static uint64 (*syscalls[])(void) = {
 [SYS_map_shared_pages] sys_map_shared_pages,
 [SYS_unmap_shared_pages] sys_unmap_shared_pages,
 [SYS_getppid] sys_getppid,
+[SYS_lockstat] sys_lockstat,
+[SYS_setpriority] sys_setpriority,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_setgang] sys_setgang,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_sched_setquantum] sys_sched_setquantum,
+[SYS_sysstat] sys_sysstat,
 };
 
+// Latency statistics for each system call, kept per CPU so
+// that CPUs do not share cache lines. A CPU updates only its
+// own, with interrupts off, so no lock is needed; readers add
+// them up and may see a call half-counted.
+static struct sysstat sysstats[NCPU][NSYSCALL];
+
+// The same for each process, indexed like proc[]. Only the
+// process itself updates its own.
+static struct sysstat procstats[NPROC][NSYSCALL];
+
+static void
+sysadd(struct sysstat *s, uint64 t, int b)
+{
+  s->ncall++;
+  s->cycles += t;
+  if(t > s->maxcycles)
+    s->maxcycles = t;
+  s->hist[b]++;
+}
+
+// Count a call of system call num by p that took t cycles.
+static void
+sysaccount(struct proc *p, int num, uint64 t)
+{
+  int b;
+
+  for(b = 0; b < NSYSHIST-1 && (t >> (b+1)) != 0; b++)
+    ;
+  sysadd(&procstats[p - proc][num], t, b);
+  push_off();
+  sysadd(&sysstats[cpuid()][num], t, b);
+  pop_off();
+}
+
+// Forget the statistics of p, which is being freed.
+void
+sysstatclear(struct proc *p)
+{
+  memset(procstats[p - proc], 0, sizeof(procstats[0]));
+}
+
+// Copy up to n struct sysstat to the user, indexed by system
+// call number: the whole system's if pid is 0, otherwise
+// process pid's.
+// Returns how many, or -1.
+int
+sysstatcopyout(int pid, uint64 addr, int n)
+{
+  struct proc *p;
+  struct sysstat s;
+  int i, c, b;
+
+  if(n < 0)
+    return -1;
+  if(n > NSYSCALL)
+    n = NSYSCALL;
+
+  for(i = 0; i < n; i++){
+    if(pid){
+      // Look pid up each time, since it may exit meanwhile.
+      if((p = find_proc_by_pid(pid)) == 0)
+        return -1;
+      s = procstats[p - proc][i];
+      release(&p->lock);
+    } else {
+      memset(&s, 0, sizeof(s));
+      for(c = 0; c < NCPU; c++){
+        s.ncall += sysstats[c][i].ncall;
+        s.cycles += sysstats[c][i].cycles;
+        if(sysstats[c][i].maxcycles > s.maxcycles)
+          s.maxcycles = sysstats[c][i].maxcycles;
+        for(b = 0; b < NSYSHIST; b++)
+          s.hist[b] += sysstats[c][i].hist[b];
+      }
+    }
+    if(copyout(myproc()->pagetable, addr + i*sizeof(s), (char*)&s, sizeof(s)) < 0)
+      return -1;
+  }
+  return n;
+}
+
 void
 syscall(void)
 {
   int num;
+  uint64 t0;
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
+    trace(TR_SYSCALL, num);
+    t0 = r_time();
     p->trapframe->a0 = syscalls[num]();
+    sysaccount(p, num, r_time() - t0);
+    trace(TR_SYSRET, num);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
@@ -22,4 +22,13 @@
 #define SYS_close  21
 #define SYS_map_shared_pages 22
 #define SYS_unmap_shared_pages 23
-#define SYS_getppid  24
\ No newline at end of file
+#define SYS_getppid  24
+#define SYS_lockstat 25
+#define SYS_setpriority 26
+#define SYS_sched_setaffinity 27
+#define SYS_sched_getaffinity 28
+#define SYS_setgang 29
+#define SYS_nanosleep 30
+#define SYS_clock_gettime 31
+#define SYS_sched_setquantum 32
+#define SYS_sysstat 33
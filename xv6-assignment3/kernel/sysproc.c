@@ -68,6 +68,23 @@ sys_sleep(void)
   return 0;
 }
 
+// nanosleep(ns): sleep for at least ns nanoseconds.
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+
+  argaddr(0, &ns);
+  return nanosleep(ns);
+}
+
+// clock_gettime(): nanoseconds since boot.
+uint64
+sys_clock_gettime(void)
+{
+  return clocknow();
+}
+
 uint64
 sys_kill(void)
 {
@@ -101,15 +118,18 @@ sys_map_shared_pages(void)
   argaddr(2, &src_va);     // Source virtual address
   argaddr(3, &size);       // Size
 
-  // Convert PIDs to proc pointers
-  struct proc *src_proc = find_proc_by_pid(src_pid);
-  struct proc *dst_proc = find_proc_by_pid(dst_pid);
-  
-  if (!src_proc || !dst_proc) {
+  // Convert PIDs to proc pointers, locked so that
+  // neither can exit and be freed while we map.
+  struct proc *src_proc, *dst_proc;
+  if (find_procs_by_pid(src_pid, dst_pid, &src_proc, &dst_proc) < 0) {
     return -1;
   }
   
-  return map_shared_pages(src_proc, dst_proc, src_va, size);
+  uint64 va = map_shared_pages(src_proc, dst_proc, src_va, size);
+  release(&src_proc->lock);
+  if (dst_proc != src_proc)
+    release(&dst_proc->lock);
+  return va;
 }
 
 uint64 
@@ -127,7 +147,9 @@ sys_unmap_shared_pages(void)
     return -1;
   }
   
-  return unmap_shared_pages(p, addr, size);
+  uint64 r = unmap_shared_pages(p, addr, size);
+  release(&p->lock);
+  return r;
 }
 
 uint64
@@ -142,3 +164,86 @@ sys_getppid(void)
   
   return p->parent->pid;
 }
+
+// Copy lock statistics to the user: lockstat(buf, n)
+// fills in up to n struct lockstat and returns how many.
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return lockstatcopyout(addr, n);
+}
+
+// Copy system call statistics to the user:
+// sysstat(pid, buf, n); see kernel/sysstat.h.
+uint64
+sys_sysstat(void)
+{
+  uint64 addr;
+  int pid, n;
+
+  argint(0, &pid);
+  argaddr(1, &addr);
+  argint(2, &n);
+  return sysstatcopyout(pid, addr, n);
+}
+
+// setpriority(pid, policy, prio); see kernel/sched.h.
+uint64
+sys_setpriority(void)
+{
+  int pid, policy, prio;
+
+  argint(0, &pid);
+  argint(1, &policy);
+  argint(2, &prio);
+  return setpriority(pid, policy, prio);
+}
+
+// sched_setaffinity(pid, mask): bit i of mask allows CPU i.
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  argint(0, &pid);
+  argint(1, &mask);
+  return setaffinity(pid, (uint)mask);
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  argint(0, &pid);
+  return getaffinity(pid);
+}
+
+// setgang(pid, gang): schedule pid together with the other
+// members of gang; 0 leaves any gang.
+uint64
+sys_setgang(void)
+{
+  int pid, gang;
+
+  argint(0, &pid);
+  argint(1, &gang);
+  return setgang(pid, gang);
+}
+
+// sched_setquantum(policy, ms): set the time slice of a
+// scheduling class, unless ms is 0; returns the old one.
+uint64
+sys_sched_setquantum(void)
+{
+  int policy, ms;
+
+  argint(0, &policy);
+  argint(1, &ms);
+  return setquantum(policy, ms);
+}
@@ -0,0 +1,13 @@
+// System call statistics, as returned by sysstat().
+// Times are in cycles of the time CSR, TIMEBASE a second,
+// from entry to return, including any time spent asleep.
+
+#define NSYSHIST 24
+
+struct sysstat {
+  uint64 ncall;
+  uint64 cycles;             // total time in the call
+  uint64 maxcycles;          // longest call
+  uint64 hist[NSYSHIST];     // hist[i]: calls of 2^i to 2^(i+1)-1 cycles;
+                             // the last bucket also counts longer ones
+};
@@ -0,0 +1,337 @@
+// High-resolution timers.
+//
+// Each CPU has a timer wheel: pending timers hashed into slots
+// by expiry time, at NLEVEL levels of coarser and coarser
+// slots, so that adding, cancelling and expiring a timer cost
+// the same however many are pending. A level-l slot covers
+// NSLOT^l units of 2^RESSHIFT cycles; when time reaches the
+// start of a slot above level 0, its timers are cascaded down
+// into the finer levels below.
+//
+// Each CPU programs its own CLINT MTIMECMP register for the
+// earliest of its next timer, the end of its running process's
+// time slice, its next profiling sample while the profiler is
+// on, and, on CPU 0 only, the next clock tick, so a
+// short sleep ends close to its deadline rather than at the
+// next tick, and a CPU with nothing to switch to takes no
+// interrupts at all. timervec in kernelvec.S disarms the
+// register when it fires, and hrtimerintr() arms it again.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "defs.h"
+
+#define RESSHIFT   10                 // a unit is 1024 cycles, about 100us
+#define LEVELBITS  6
+#define NSLOT      (1 << LEVELBITS)
+#define NLEVEL     4
+#define NSPERCYCLE (1000000000L / TIMEBASE)
+#define TICKCYCLES (TIMEBASE / TICKHZ)
+
+struct timer {
+  uint64 when;                 // expiry time, in units
+  int fired;
+  int level, slot;             // where it is in the wheel
+  struct timer *next, *prev;
+};
+
+struct wheel {
+  struct spinlock lock;
+  uint64 now;                  // units up to which timers have run
+  uint64 nexttick;             // cycle count of the next clock tick, or ~0
+  uint64 sliceend;             // cycle count when the time slice ends, or ~0
+  uint64 nextsample;           // cycle count of the next profiling sample, or ~0
+  int n;                       // pending timers
+  struct timer *slot[NLEVEL][NSLOT];
+} wheels[NCPU];
+
+static uint64 sampleperiod;    // cycles between profiling samples
+
+void
+hrtimerinit(void)
+{
+  struct wheel *w;
+
+  for(w = wheels; w < &wheels[NCPU]; w++){
+    initlock(&w->lock, "wheel");
+    w->nexttick = ~0UL;
+    w->sliceend = ~0UL;
+    w->nextsample = ~0UL;
+  }
+  // CPU 0 keeps time for everyone.
+  wheels[0].nexttick = 0;
+}
+
+// Put t in the slot for its expiry time.
+// Caller must hold w->lock.
+static void
+wheeladd(struct wheel *w, struct timer *t)
+{
+  uint64 when, delta;
+  int l;
+
+  when = t->when < w->now ? w->now : t->when;
+  delta = when - w->now;
+  if(delta >= 1L << (LEVELBITS*NLEVEL)){
+    // Too far ahead: park it at the end of the top level,
+    // and it will be cascaded back there until its time.
+    when = w->now + (1L << (LEVELBITS*NLEVEL)) - 1;
+    delta = when - w->now;
+  }
+  for(l = 0; l < NLEVEL-1 && delta >= 1L << (LEVELBITS*(l+1)); l++)
+    ;
+  t->level = l;
+  t->slot = (when >> (LEVELBITS*l)) & (NSLOT-1);
+  t->prev = 0;
+  t->next = w->slot[l][t->slot];
+  if(t->next)
+    t->next->prev = t;
+  w->slot[l][t->slot] = t;
+  w->n++;
+}
+
+// Caller must hold w->lock.
+static void
+wheeldel(struct wheel *w, struct timer *t)
+{
+  if(t->prev)
+    t->prev->next = t->next;
+  else
+    w->slot[t->level][t->slot] = t->next;
+  if(t->next)
+    t->next->prev = t->prev;
+  w->n--;
+}
+
+// Return the first unit after w->now at which a timer
+// expires or a slot must be cascaded, or ~0 if none.
+// Caller must hold w->lock.
+static uint64
+wheelnext(struct wheel *w)
+{
+  uint64 base, next;
+  int l, d, shift;
+
+  next = ~0UL;
+  if(w->n == 0)
+    return next;
+  for(l = 0; l < NLEVEL; l++){
+    shift = LEVELBITS*l;
+    base = w->now >> shift;
+    for(d = 1; d <= NSLOT; d++){
+      if(w->slot[l][(base + d) & (NSLOT-1)]){
+        if(((base + d) << shift) < next)
+          next = (base + d) << shift;
+        break;
+      }
+    }
+  }
+  return next;
+}
+
+// Run the timers that expire by unit target.
+// Caller must hold w->lock.
+static void
+wheelrun(struct wheel *w, uint64 target)
+{
+  struct timer *t, *next;
+  uint64 u;
+  int l, i;
+
+  while((u = wheelnext(w)) <= target){
+    w->now = u;
+
+    // Cascade the coarser slots that begin at u.
+    for(l = 1; l < NLEVEL && (u & ((1L << (LEVELBITS*l)) - 1)) == 0; l++){
+      i = (u >> (LEVELBITS*l)) & (NSLOT-1);
+      t = w->slot[l][i];
+      w->slot[l][i] = 0;
+      for(; t; t = next){
+        next = t->next;
+        w->n--;
+        wheeladd(w, t);
+      }
+    }
+
+    i = u & (NSLOT-1);
+    t = w->slot[0][i];
+    w->slot[0][i] = 0;
+    for(; t; t = next){
+      next = t->next;
+      w->n--;
+      t->fired = 1;
+      wakeup(t);
+    }
+  }
+  if(target > w->now)
+    w->now = target;
+}
+
+// Program CPU id's timer for the earliest of its next
+// clock tick, the end of its time slice, its next profiling
+// sample and its next timer.
+// Caller must hold w->lock.
+static void
+wheelarm(struct wheel *w, int id)
+{
+  uint64 next, u;
+
+  next = w->nexttick;
+  if(w->sliceend < next)
+    next = w->sliceend;
+  if(w->nextsample < next)
+    next = w->nextsample;
+  u = wheelnext(w);
+  if(u < (next >> RESSHIFT))
+    next = u << RESSHIFT;
+  *(volatile uint64*)CLINT_MTIMECMP(id) = next;
+}
+
+// Handle a timer interrupt or IPI on this CPU: count a clock
+// tick or a profiling sample if one is due, run expired
+// timers, and re-arm.
+// Returns 1 if the running process's time slice is over.
+int
+hrtimerintr(void)
+{
+  int id = cpuid();
+  struct wheel *w = &wheels[id];
+  uint64 now = r_time();
+  int tick = 0, sample = 0, over = 0;
+
+  acquire(&w->lock);
+  if(now >= w->nexttick){
+    tick = 1;
+    w->nexttick += TICKCYCLES;
+    if(w->nexttick <= now)
+      w->nexttick = now + TICKCYCLES;
+  }
+  if(now >= w->nextsample){
+    sample = 1;
+    w->nextsample += sampleperiod;
+    if(w->nextsample <= now)
+      w->nextsample = now + sampleperiod;
+  }
+  if(now >= w->sliceend){
+    over = 1;
+    w->sliceend = ~0UL;
+  }
+  wheelrun(w, now >> RESSHIFT);
+  wheelarm(w, id);
+  release(&w->lock);
+
+  if(tick)
+    clockintr();
+  if(sample)
+    proftick();
+  return over;
+}
+
+// Set the end of the time slice of the process this CPU is
+// running or about to run, or clear it with ~0. A deadline
+// is only ever lowered, so that an earlier one set by
+// hrtimerpoke() since the slice was cleared still stands.
+// Called with interrupts off.
+void
+hrtimerslice(uint64 when)
+{
+  int id = cpuid();
+  struct wheel *w = &wheels[id];
+
+  if(when == ~0UL)
+    w->sliceend = when;
+  else
+    hrtimerpoke(id, when);
+  __sync_synchronize();
+  when = *(volatile uint64*)&w->sliceend;
+  // Only this CPU arms its timer, and it cannot be
+  // interrupted here, so there is no race in doing it
+  // without the wheel's lock. A later deadline waits for
+  // the next interrupt, which re-arms the timer correctly,
+  // and a poke after the read above comes with an IPI.
+  if(when < *(volatile uint64*)CLINT_MTIMECMP(id))
+    *(volatile uint64*)CLINT_MTIMECMP(id) = when;
+}
+
+// Another process is waiting for CPU id: end the time slice
+// of the process running there by when, if it would run
+// longer. Returns 1 if so; the caller should then interrupt
+// CPU id so that it re-arms its timer.
+int
+hrtimerpoke(int id, uint64 when)
+{
+  uint64 old;
+
+  do {
+    old = *(volatile uint64*)&wheels[id].sliceend;
+    if(old <= when)
+      return 0;
+  } while(!__sync_bool_compare_and_swap(&wheels[id].sliceend, old, when));
+  return 1;
+}
+
+// Interrupt every CPU each period cycles to take a
+// profiling sample, or stop if period is 0.
+void
+hrtimerprof(uint64 period)
+{
+  struct wheel *w;
+  uint64 now = r_time();
+
+  sampleperiod = period;
+  for(w = wheels; w < &wheels[NCPU]; w++){
+    acquire(&w->lock);
+    w->nextsample = period ? now : ~0UL;
+    release(&w->lock);
+  }
+  // A CPU running a lone process may take no interrupt for a
+  // long time, so make every CPU re-arm its timer now.
+  kickall();
+}
+
+// Sleep for at least ns nanoseconds.
+// Returns -1 if killed first.
+int
+nanosleep(uint64 ns)
+{
+  struct timer t;
+  struct wheel *w;
+
+  // Round up, so as never to wake early.
+  t.when = (r_time() + (ns + NSPERCYCLE - 1) / NSPERCYCLE + (1 << RESSHIFT) - 1) >> RESSHIFT;
+  t.fired = 0;
+
+  // Use this CPU's wheel, so that it can arm its own timer.
+  push_off();
+  w = &wheels[cpuid()];
+  acquire(&w->lock);
+  pop_off();
+  if(t.when <= w->now){
+    release(&w->lock);
+    return 0;
+  }
+  wheeladd(w, &t);
+  wheelarm(w, w - wheels);
+
+  while(!t.fired){
+    if(killed(myproc())){
+      wheeldel(w, &t);
+      release(&w->lock);
+      return -1;
+    }
+    sleep(&t, &w->lock);
+  }
+  release(&w->lock);
+  return 0;
+}
+
+// Nanoseconds since boot.
+uint64
+clocknow(void)
+{
+  return r_time() * NSPERCYCLE;
+}
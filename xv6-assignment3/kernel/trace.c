@@ -0,0 +1,158 @@
+// Kernel event tracing.
+//
+// Tracepoints call trace(), which appends a struct traceevent
+// to the ring of the CPU it runs on. Only that CPU writes the
+// ring, with interrupts off, and only readers of the trace
+// device take events out, so the ring needs no lock: the
+// writer owns tail and the readers own head, and each
+// publishes its index only after it is done with the slots.
+// Readers take ring->lock to exclude each other.
+//
+// A full ring drops events, and the next event that fits is
+// preceded by a TR_LOST event that counts them.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "trace.h"
+#include "defs.h"
+
+#define NTRACE     1024            // events per CPU
+#define TRACEPOLL  10000000        // ns between looks at empty rings
+
+struct tracering {
+  struct spinlock lock;            // readers only
+  uint head;                       // next to read, set by readers
+  uint tail;                       // next to write, set by this CPU
+  uint lost;                       // events dropped since the last TR_LOST
+  struct traceevent buf[NTRACE];
+} tracering[NCPU];
+
+static int traceon;
+
+static int traceread(int, uint64, int);
+static int tracewrite(int, uint64, int);
+
+void
+traceinit(void)
+{
+  struct tracering *r;
+
+  for(r = tracering; r < &tracering[NCPU]; r++)
+    initlock(&r->lock, "trace");
+  devsw[TRACE].read = traceread;
+  devsw[TRACE].write = tracewrite;
+}
+
+// Record an event of the given type on this CPU.
+void
+trace(int type, uint64 arg)
+{
+  struct tracering *r;
+  struct traceevent *e;
+  struct proc *p;
+  uint head, tail, need;
+  int id;
+
+  if(*(volatile int*)&traceon == 0)
+    return;
+
+  push_off();
+  id = cpuid();
+  r = &tracering[id];
+  p = mycpu()->proc;
+  head = *(volatile uint*)&r->head;
+  __sync_synchronize();
+  tail = r->tail;
+  need = r->lost ? 2 : 1;
+  if(NTRACE - (tail - head) < need){
+    r->lost++;
+    pop_off();
+    return;
+  }
+  if(r->lost){
+    e = &r->buf[tail++ % NTRACE];
+    e->time = r_time();
+    e->type = TR_LOST;
+    e->cpu = id;
+    e->pid = p ? p->pid : 0;
+    e->arg = r->lost;
+    r->lost = 0;
+  }
+  e = &r->buf[tail++ % NTRACE];
+  e->time = r_time();
+  e->type = type;
+  e->cpu = id;
+  e->pid = p ? p->pid : 0;
+  e->arg = arg;
+  __sync_synchronize();
+  r->tail = tail;
+  pop_off();
+}
+
+// Read whole events. If there are none, wait for some while
+// tracing is on; return 0 once it is off and all are read.
+static int
+traceread(int user_dst, uint64 dst, int n)
+{
+  struct tracering *r;
+  struct traceevent e;
+  int got;
+
+  if(n < sizeof(e))
+    return -1;
+  for(;;){
+    got = 0;
+    for(r = tracering; r < &tracering[NCPU]; r++){
+      while(n - got >= sizeof(e)){
+        acquire(&r->lock);
+        if(r->head == *(volatile uint*)&r->tail){
+          release(&r->lock);
+          break;
+        }
+        __sync_synchronize();
+        e = r->buf[r->head % NTRACE];
+        __sync_synchronize();
+        r->head++;
+        release(&r->lock);
+        if(either_copyout(user_dst, dst + got, &e, sizeof(e)) < 0)
+          return -1;
+        got += sizeof(e);
+      }
+    }
+    if(got > 0 || *(volatile int*)&traceon == 0)
+      return got;
+    if(nanosleep(TRACEPOLL) < 0)
+      return -1;
+  }
+}
+
+// "1" starts tracing, discarding unread events;
+// "0" stops it.
+static int
+tracewrite(int user_src, uint64 src, int n)
+{
+  struct tracering *r;
+  char c;
+
+  if(n < 1 || either_copyin(&c, user_src, src, 1) < 0)
+    return -1;
+  if(c == '1'){
+    for(r = tracering; r < &tracering[NCPU]; r++){
+      acquire(&r->lock);
+      r->head = *(volatile uint*)&r->tail;
+      release(&r->lock);
+    }
+    traceon = 1;
+  } else if(c == '0'){
+    traceon = 0;
+  } else {
+    return -1;
+  }
+  return n;
+}
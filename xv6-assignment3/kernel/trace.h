@@ -0,0 +1,28 @@
+// Kernel trace events, as read from the trace device.
+// Writing "1" to the device starts tracing; "0" stops it.
+// A read returns whole events, each CPU's in time order;
+// merge them by time for a timeline.
+
+#define TR_LOST       1   // arg: events dropped on this CPU, ring full
+#define TR_RUN        2   // the scheduler switched to pid
+#define TR_SWITCH     3   // pid gave up the CPU; arg: its enum procstate
+#define TR_SLEEP      4   // arg: wait channel
+#define TR_WAKEUP     5   // arg: pid woken
+#define TR_SYSCALL    6   // arg: system call number
+#define TR_SYSRET     7   // arg: system call number
+#define TR_DISKRW     8   // request sent to disk; arg: blockno*2 + write
+#define TR_DISKINTR   9   // request done; arg: blockno*2 + write
+#define TR_BEGINOP   10   // FS operation admitted; arg: ops outstanding
+#define TR_COMMIT    11   // log commit starts; arg: blocks in the log
+#define TR_COMMITDONE 12  // log commit done
+#define TR_KALLOC    13   // arg: page allocated, or 0 if none was free
+#define TR_FAULT     14   // user page fault; arg: faulting address
+
+struct traceevent {
+  uint64 time;       // time CSR, TIMEBASE cycles a second
+  uchar type;        // TR_*
+  uchar cpu;
+  ushort pad;
+  int pid;           // process running on the CPU, or 0
+  uint64 arg;
+};
@@ -4,6 +4,7 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "trace.h"
 #include "defs.h"
 
 struct spinlock tickslock;
@@ -16,6 +17,7 @@ void kernelvec();
 
 extern int devintr();
 
+
 void
 trapinit(void)
 {
@@ -66,8 +68,12 @@ usertrap(void)
 
     syscall();
   } else if((which_dev = devintr()) != 0){
-    // ok
+    // record where the process was, if a profiling sample is due.
+    if(profdue())
+      profuser(p);
   } else {
+    if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15)
+      trace(TR_FAULT, r_stval());
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
     setkilled(p);
@@ -76,9 +82,9 @@ usertrap(void)
   if(killed(p))
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
+  // give up the CPU if its time slice is over.
   if(which_dev == 2)
-    yield();
+    preempt();
 
   usertrapret();
 }
@@ -150,9 +156,15 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
+  // record where the kernel was, if a profiling sample is due.
+  // kernelvec.S does not save s0, so the interrupted code's
+  // frame pointer is the one this function's prologue saved.
+  if(profdue())
+    profkernel(sepc, *(uint64*)(r_fp() - 16));
+
+  // give up the CPU if its time slice is over.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+    preempt();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -161,7 +173,7 @@ kerneltrap()
 }
 
 void
-clockintr()
+clockintr(void)
 {
   acquire(&tickslock);
   ticks++;
@@ -171,7 +183,7 @@ clockintr()
 
 // check if it's an external interrupt or software interrupt,
 // and handle it.
-// returns 2 if timer interrupt,
+// returns 2 if the time slice is over,
 // 1 if other device,
 // 0 if not recognized.
 int
@@ -202,18 +214,17 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or an IPI, forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // either way, run due timers, and report whether the
+    // running process's time slice is over. an IPI may have
+    // just woken this CPU from wfi, or changed its slice.
+    return hrtimerintr() ? 2 : 1;
   } else {
     return 0;
   }
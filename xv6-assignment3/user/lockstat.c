@@ -0,0 +1,32 @@
+// Print the kernel's lock contention statistics,
+// one line per lock class.
+
+#include "kernel/types.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define NCLASS 64
+
+struct lockstat ls[NCLASS];
+
+int
+main(int argc, char *argv[])
+{
+  int i, n;
+
+  if((n = lockstat(ls, NCLASS)) < 0){
+    fprintf(2, "lockstat: failed\n");
+    exit(1);
+  }
+  for(i = 0; i < n; i++){
+    if(ls[i].kind == LS_SPIN)
+      printf("spin %s: acquire %l contended %l spin-cycles %l max-hold %l\n",
+             ls[i].name, ls[i].nacquire, ls[i].ncontended,
+             ls[i].spincycles, ls[i].maxhold);
+    else
+      printf("sleep %s: acquire %l contended %l spun %l slept %l\n",
+             ls[i].name, ls[i].nacquire, ls[i].ncontended,
+             ls[i].nspin, ls[i].nsleep);
+  }
+  exit(0);
+}
@@ -0,0 +1,41 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+// nice n command [args...]: run command with nice value n.
+// nice -r prio command [args...]: run it as a real-time
+// process with priority prio.
+int
+main(int argc, char *argv[])
+{
+  int policy, prio;
+  char **cmd;
+
+  if(argc >= 2 && strcmp(argv[1], "-r") == 0){
+    if(argc < 4)
+      goto usage;
+    policy = SCHED_FIFO;
+    prio = atoi(argv[2]);
+    cmd = argv + 3;
+  } else if(argc >= 3){
+    policy = SCHED_FAIR;
+    // atoi() does not take a sign.
+    prio = argv[1][0] == '-' ? -atoi(argv[1] + 1) : atoi(argv[1]);
+    cmd = argv + 2;
+  } else {
+    goto usage;
+  }
+
+  if(setpriority(0, policy, prio) < 0){
+    fprintf(2, "nice: bad priority %s\n", policy == SCHED_FIFO ? argv[2] : argv[1]);
+    exit(1);
+  }
+  exec(cmd[0], cmd);
+  fprintf(2, "nice: exec %s failed\n", cmd[0]);
+  exit(1);
+
+usage:
+  fprintf(2, "usage: nice n command... | nice -r prio command...\n");
+  exit(1);
+}
@@ -0,0 +1,269 @@
+// Profile a command: sample every CPU while it runs, then
+// print a flat profile of where the samples fell, by kernel
+// function or by user process, and the most common kernel
+// call stacks, with addresses resolved against kernel.sym.
+//
+// usage: prof command [args...]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/fs.h"
+#include "kernel/file.h"
+#include "kernel/fcntl.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+#define NUSER   32
+#define NSTACK  128
+#define NTOP    20
+
+struct sym {
+  uint64 addr;
+  char *name;
+};
+
+struct stack {
+  int n;
+  int depth;
+  int fn[PROFDEPTH];     // index in syms[] of each frame's function
+};
+
+struct sym *syms;
+int nsym;
+int *kcount;             // samples in each kernel function
+struct {
+  int pid;
+  int n;
+} ucount[NUSER];
+int nuser;
+struct stack stacks[NSTACK];
+int nstack;
+int total, nkernel;
+struct profsample buf[32];
+
+// Read the "address name" lines of a symbol table,
+// sorted by address.
+void
+loadsyms(char *path)
+{
+  struct stat st;
+  struct sym t;
+  char *s, *p;
+  int fd, i, j, n;
+
+  if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+    fprintf(2, "prof: cannot read %s\n", path);
+    exit(1);
+  }
+  s = malloc(st.size + 1);
+  for(i = 0; i < st.size; i += n)
+    if((n = read(fd, s + i, st.size - i)) <= 0)
+      break;
+  s[i] = 0;
+  close(fd);
+
+  n = 1;
+  for(p = s; *p; p++)
+    if(*p == '\n')
+      n++;
+  syms = malloc(n * sizeof(struct sym));
+  kcount = malloc(n * sizeof(int));
+  memset(kcount, 0, n * sizeof(int));
+
+  for(p = s; *p; ){
+    t.addr = 0;
+    for(; (*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f'); p++)
+      t.addr = t.addr*16 + (*p <= '9' ? *p - '0' : *p - 'a' + 10);
+    if(*p == ' ')
+      p++;
+    t.name = p;
+    while(*p && *p != '\n')
+      p++;
+    if(*p)
+      *p++ = 0;
+    // Skip section names, which share addresses with functions.
+    if(t.name[0] == 0 || t.name[0] == '.')
+      continue;
+    for(j = nsym; j > 0 && syms[j-1].addr > t.addr; j--)
+      syms[j] = syms[j-1];
+    syms[j] = t;
+    nsym++;
+  }
+}
+
+// Return the index of the symbol containing pc, or -1.
+int
+lookup(uint64 pc)
+{
+  int lo, hi, mid;
+
+  if(nsym == 0 || pc < syms[0].addr)
+    return -1;
+  lo = 0;
+  hi = nsym;
+  while(hi - lo > 1){
+    mid = (lo + hi) / 2;
+    if(syms[mid].addr <= pc)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+void
+addsample(struct profsample *s)
+{
+  struct stack *st;
+  int fn[PROFDEPTH];
+  int i;
+
+  total++;
+  if(s->user){
+    for(i = 0; i < nuser && ucount[i].pid != s->pid; i++)
+      ;
+    if(i == nuser && nuser < NUSER)
+      ucount[nuser++].pid = s->pid;
+    if(i < NUSER)
+      ucount[i].n++;
+    return;
+  }
+
+  nkernel++;
+  // Return addresses point just past the call, which may be
+  // the first instruction of the next function.
+  for(i = 0; i < s->depth; i++)
+    fn[i] = lookup(i == 0 ? s->pc[0] : s->pc[i] - 1);
+  if(fn[0] >= 0)
+    kcount[fn[0]]++;
+
+  for(st = stacks; st < &stacks[nstack]; st++)
+    if(st->depth == s->depth && memcmp(st->fn, fn, s->depth * sizeof(int)) == 0)
+      break;
+  if(st == &stacks[NSTACK])
+    return;
+  if(st == &stacks[nstack]){
+    nstack++;
+    st->depth = s->depth;
+    memmove(st->fn, fn, s->depth * sizeof(int));
+  }
+  st->n++;
+}
+
+char*
+fname(int i)
+{
+  return i < 0 ? "?" : syms[i].name;
+}
+
+void
+pct(int n)
+{
+  printf("%d.%d%%", n * 100 / total, n * 1000 / total % 10);
+}
+
+void
+report(void)
+{
+  int i, j, k, best;
+
+  if(total == 0){
+    printf("prof: no samples\n");
+    return;
+  }
+  printf("%d samples, %d in the kernel\n", total, nkernel);
+
+  printf("kernel functions:\n");
+  for(k = 0; k < NTOP; k++){
+    best = -1;
+    for(i = 0; i < nsym; i++)
+      if(kcount[i] > 0 && (best < 0 || kcount[i] > kcount[best]))
+        best = i;
+    if(best < 0)
+      break;
+    printf("  ");
+    pct(kcount[best]);
+    printf(" %d %s\n", kcount[best], syms[best].name);
+    kcount[best] = 0;
+  }
+
+  printf("user processes:\n");
+  for(k = 0; k < NTOP; k++){
+    best = -1;
+    for(i = 0; i < nuser; i++)
+      if(ucount[i].n > 0 && (best < 0 || ucount[i].n > ucount[best].n))
+        best = i;
+    if(best < 0)
+      break;
+    printf("  ");
+    pct(ucount[best].n);
+    printf(" %d pid %d\n", ucount[best].n, ucount[best].pid);
+    ucount[best].n = 0;
+  }
+
+  printf("kernel call stacks:\n");
+  for(k = 0; k < NTOP; k++){
+    best = -1;
+    for(i = 0; i < nstack; i++)
+      if(stacks[i].n > 0 && (best < 0 || stacks[i].n > stacks[best].n))
+        best = i;
+    if(best < 0)
+      break;
+    printf("  %d %s", stacks[best].n, fname(stacks[best].fn[0]));
+    for(j = 1; j < stacks[best].depth; j++)
+      printf(" <- %s", fname(stacks[best].fn[j]));
+    printf("\n");
+    stacks[best].n = 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, pid, n, i;
+
+  if(argc < 2){
+    fprintf(2, "usage: prof command [args...]\n");
+    exit(1);
+  }
+  loadsyms("/kernel.sym");
+
+  if((fd = open("/prof", O_RDWR)) < 0){
+    mknod("/prof", PROF, 0);
+    fd = open("/prof", O_RDWR);
+  }
+  if(fd < 0 || write(fd, "1", 1) != 1){
+    fprintf(2, "prof: cannot start profiling\n");
+    exit(1);
+  }
+
+  // The child runs the command and then stops profiling,
+  // after which reads here return 0 once all samples are in.
+  pid = fork();
+  if(pid < 0){
+    write(fd, "0", 1);
+    fprintf(2, "prof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if((pid = fork()) == 0){
+      close(fd);
+      exec(argv[1], argv + 1);
+      fprintf(2, "prof: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    if(pid > 0)
+      wait(0);
+    write(fd, "0", 1);
+    exit(0);
+  }
+
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    for(i = 0; i < n / sizeof(buf[0]); i++)
+      addsample(&buf[i]);
+  wait(0);
+  report();
+  exit(0);
+}
@@ -0,0 +1,129 @@
+// Print system call statistics, busiest call first:
+//   sysstat                 the whole system's, since boot
+//   sysstat -p pid          process pid's
+//   sysstat command args    the whole system's while command runs
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/memlayout.h"
+#include "kernel/syscall.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+#define NSPERCYCLE (1000000000L / TIMEBASE)
+
+char *names[NSYSCALL] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_read]    "read",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_fstat]   "fstat",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_open]    "open",
+[SYS_write]   "write",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_close]   "close",
+[SYS_map_shared_pages] "map_shared_pages",
+[SYS_unmap_shared_pages] "unmap_shared_pages",
+[SYS_getppid] "getppid",
+[SYS_lockstat] "lockstat",
+[SYS_setpriority] "setpriority",
+[SYS_sched_setaffinity] "sched_setaffinity",
+[SYS_sched_getaffinity] "sched_getaffinity",
+[SYS_setgang] "setgang",
+[SYS_nanosleep] "nanosleep",
+[SYS_clock_gettime] "clock_gettime",
+[SYS_sched_setquantum] "sched_setquantum",
+[SYS_sysstat] "sysstat",
+};
+
+struct sysstat before[NSYSCALL], st[NSYSCALL];
+
+void
+get(int pid, struct sysstat *s)
+{
+  if(sysstat(pid, s, NSYSCALL) < 0){
+    fprintf(2, "sysstat: failed\n");
+    exit(1);
+  }
+}
+
+void
+report(void)
+{
+  uint64 total;
+  int i, b, best;
+
+  total = 0;
+  for(i = 0; i < NSYSCALL; i++)
+    total += st[i].cycles;
+  if(total == 0)
+    total = 1;
+
+  for(;;){
+    best = -1;
+    for(i = 0; i < NSYSCALL; i++)
+      if(st[i].ncall > 0 && (best < 0 || st[i].cycles > st[best].cycles))
+        best = i;
+    if(best < 0)
+      break;
+    printf("%s: %d%% calls %l total-ns %l avg-ns %l",
+           names[best] ? names[best] : "?", (int)(st[best].cycles * 100 / total),
+           st[best].ncall, st[best].cycles * NSPERCYCLE,
+           st[best].cycles * NSPERCYCLE / st[best].ncall);
+    if(st[best].maxcycles)
+      printf(" max-ns %l", st[best].maxcycles * NSPERCYCLE);
+    printf("\n");
+    for(b = 0; b < NSYSHIST; b++)
+      if(st[best].hist[b])
+        printf("    >= %l ns: %l\n", (1L << b) * NSPERCYCLE, st[best].hist[b]);
+    st[best].ncall = 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, i, b;
+
+  if(argc == 3 && strcmp(argv[1], "-p") == 0){
+    get(atoi(argv[2]), st);
+  } else if(argc > 1){
+    get(0, before);
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "sysstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "sysstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+    get(0, st);
+    for(i = 0; i < NSYSCALL; i++){
+      st[i].ncall -= before[i].ncall;
+      st[i].cycles -= before[i].cycles;
+      for(b = 0; b < NSYSHIST; b++)
+        st[i].hist[b] -= before[i].hist[b];
+      // The maximum cannot be split; leave it out.
+      st[i].maxcycles = 0;
+    }
+  } else {
+    get(0, st);
+  }
+  report();
+  exit(0);
+}
@@ -0,0 +1,177 @@
+// Record kernel trace events while a command runs, or print
+// a recorded trace as a timeline, merged across CPUs:
+//   trace file command args    record into file
+//   trace -p file              print file
+//
+// Writing the file makes trace events of its own.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/fs.h"
+#include "kernel/file.h"
+#include "kernel/fcntl.h"
+#include "kernel/memlayout.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+#define NSPERCYCLE (1000000000L / TIMEBASE)
+
+char *states[] = { "unused", "used", "sleeping", "runnable", "running", "zombie" };
+
+struct traceevent buf[64];
+
+void
+record(char *path, char **argv)
+{
+  int fd, out, pid, n;
+
+  if((out = open(path, O_CREATE|O_WRONLY|O_TRUNC)) < 0){
+    fprintf(2, "trace: cannot create %s\n", path);
+    exit(1);
+  }
+  if((fd = open("/trace", O_RDWR)) < 0){
+    mknod("/trace", TRACE, 0);
+    fd = open("/trace", O_RDWR);
+  }
+  if(fd < 0 || write(fd, "1", 1) != 1){
+    fprintf(2, "trace: cannot start tracing\n");
+    exit(1);
+  }
+
+  // The child runs the command and then stops tracing,
+  // after which reads here return 0 once all events are in.
+  pid = fork();
+  if(pid < 0){
+    write(fd, "0", 1);
+    fprintf(2, "trace: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(out);
+    if((pid = fork()) == 0){
+      close(fd);
+      exec(argv[0], argv);
+      fprintf(2, "trace: exec %s failed\n", argv[0]);
+      exit(1);
+    }
+    if(pid > 0)
+      wait(0);
+    write(fd, "0", 1);
+    exit(0);
+  }
+
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    if(write(out, buf, n) != n){
+      fprintf(2, "trace: write %s failed\n", path);
+      break;
+    }
+  }
+  wait(0);
+  close(out);
+}
+
+void
+show(struct traceevent *e, uint64 t0)
+{
+  uint64 a = e->arg;
+
+  printf("%l cpu %d pid %d ", (e->time - t0) * NSPERCYCLE / 1000, e->cpu, e->pid);
+  switch(e->type){
+  case TR_LOST:
+    printf("lost %l\n", a);
+    break;
+  case TR_RUN:
+    printf("run\n");
+    break;
+  case TR_SWITCH:
+    printf("switch %s\n", a < sizeof(states)/sizeof(states[0]) ? states[a] : "?");
+    break;
+  case TR_SLEEP:
+    printf("sleep %p\n", a);
+    break;
+  case TR_WAKEUP:
+    printf("wakeup pid %d\n", (int)a);
+    break;
+  case TR_SYSCALL:
+    printf("syscall %d\n", (int)a);
+    break;
+  case TR_SYSRET:
+    printf("sysret %d\n", (int)a);
+    break;
+  case TR_DISKRW:
+  case TR_DISKINTR:
+    printf("%s %s block %l\n", e->type == TR_DISKRW ? "disk" : "diskdone",
+           (a & 1) ? "write" : "read", a >> 1);
+    break;
+  case TR_BEGINOP:
+    printf("begin_op outstanding %d\n", (int)a);
+    break;
+  case TR_COMMIT:
+    printf("commit %d blocks\n", (int)a);
+    break;
+  case TR_COMMITDONE:
+    printf("commit done\n");
+    break;
+  case TR_KALLOC:
+    printf("kalloc %p\n", a);
+    break;
+  case TR_FAULT:
+    printf("fault %p\n", a);
+    break;
+  default:
+    printf("event %d %p\n", e->type, a);
+  }
+}
+
+void
+print(char *path)
+{
+  struct stat st;
+  struct traceevent *ev, t;
+  int fd, n, i, j, gap;
+
+  if((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+    fprintf(2, "trace: cannot read %s\n", path);
+    exit(1);
+  }
+  if((n = st.size / sizeof(struct traceevent)) == 0)
+    return;
+  if((ev = malloc(n * sizeof(struct traceevent))) == 0){
+    fprintf(2, "trace: %s is too big\n", path);
+    exit(1);
+  }
+  if(read(fd, ev, n * sizeof(struct traceevent)) != n * sizeof(struct traceevent)){
+    fprintf(2, "trace: read %s failed\n", path);
+    exit(1);
+  }
+  close(fd);
+
+  // Each CPU's events are in order, but the reads interleave
+  // the CPUs; Shell sort them by time.
+  for(gap = n/2; gap > 0; gap /= 2){
+    for(i = gap; i < n; i++){
+      t = ev[i];
+      for(j = i; j >= gap && ev[j-gap].time > t.time; j -= gap)
+        ev[j] = ev[j-gap];
+      ev[j] = t;
+    }
+  }
+  for(i = 0; i < n; i++)
+    show(&ev[i], ev[0].time);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if(argc == 3 && strcmp(argv[1], "-p") == 0){
+    print(argv[2]);
+  } else if(argc >= 3){
+    record(argv[1], argv + 2);
+  } else {
+    fprintf(2, "usage: trace file command [args...] | trace -p file\n");
+    exit(1);
+  }
+  exit(0);
+}
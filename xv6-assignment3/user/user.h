@@ -1,4 +1,6 @@
 struct stat;
+struct lockstat;
+struct sysstat;
 
 // system calls
 int fork(void);
@@ -25,6 +27,15 @@ int uptime(void);
 uint64 map_shared_pages(int src_pid, int dst_pid, uint64 src_va, uint64 size);
 uint64 unmap_shared_pages(int pid, uint64 addr, uint64 size);
 int getppid(void);
+int lockstat(struct lockstat*, int);
+int setpriority(int, int, int);
+int sched_setaffinity(int, int);
+int sched_getaffinity(int);
+int setgang(int, int);
+int nanosleep(uint64);
+uint64 clock_gettime(void);
+int sched_setquantum(int, int);
+int sysstat(int, struct sysstat*, int);
 
 
 // ulib.c
@@ -7,6 +7,13 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/sched.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/file.h"
+#include "kernel/prof.h"
+#include "kernel/sysstat.h"
+#include "kernel/trace.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -575,10 +582,12 @@ writetest(char *s)
   }
 }
 
+// write a file that reaches into the doubly-indirect blocks.
 void
 writebig(char *s)
 {
   int i, fd, n;
+  int nblocks = NDIRECT + 3*NINDIRECT;
 
   fd = open("big", O_CREATE|O_RDWR);
   if(fd < 0){
@@ -586,7 +595,7 @@ writebig(char *s)
     exit(1);
   }
 
-  for(i = 0; i < MAXFILE; i++){
+  for(i = 0; i < nblocks; i++){
     ((int*)buf)[0] = i;
     if(write(fd, buf, BSIZE) != BSIZE){
       printf("%s: error: write big file failed\n", s, i);
@@ -606,7 +615,7 @@ writebig(char *s)
   for(;;){
     i = read(fd, buf, BSIZE);
     if(i == 0){
-      if(n == MAXFILE - 1){
+      if(n != nblocks){
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
       }
@@ -1049,6 +1058,598 @@ reparent2(char *s)
   exit(0);
 }
 
+// setpriority() checks its arguments, and a real-time
+// process that spins on one CPU cannot keep its parent from
+// running on another.
+void
+schedprio(char *s)
+{
+  int pid, xstatus, all, cpu;
+
+  if(setpriority(0, SCHED_FAIR, 20) != -1 ||
+     setpriority(0, SCHED_FIFO, 0) != -1 ||
+     setpriority(0, 7, 0) != -1){
+    printf("%s: setpriority accepted a bad argument\n", s);
+    exit(1);
+  }
+  if(setpriority(0, SCHED_FAIR, 5) != 0 || setpriority(0, SCHED_FAIR, 0) != 0){
+    printf("%s: setpriority(SCHED_FAIR) failed\n", s);
+    exit(1);
+  }
+
+  all = sched_getaffinity(0);
+  if((all & ~1) == 0)
+    return;
+  cpu = all & ~1;
+  cpu &= -cpu;
+
+  // a spinning FIFO process starves anything that shares its
+  // run queue, so the child gets a CPU of its own: it inherits
+  // cpu, and we move to CPU 0.
+  if(sched_setaffinity(0, cpu) != 0){
+    printf("%s: sched_setaffinity failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(;;)
+      ;
+  }
+  if(sched_setaffinity(0, 1) != 0){
+    printf("%s: sched_setaffinity failed\n", s);
+    exit(1);
+  }
+  if(setpriority(pid, SCHED_FIFO, 10) != 0){
+    printf("%s: setpriority(SCHED_FIFO) failed\n", s);
+    exit(1);
+  }
+  sleep(2);
+  kill(pid);
+  wait(&xstatus);
+  sched_setaffinity(0, all);
+  if(xstatus != -1){
+    printf("%s: spinning child exited with %d\n", s, xstatus);
+    exit(1);
+  }
+  if(setpriority(pid, SCHED_FAIR, 0) != -1){
+    printf("%s: setpriority on a dead process\n", s);
+    exit(1);
+  }
+}
+
+// sched_setaffinity() pins a process, and its children,
+// to the CPUs it names.
+void
+affinity(char *s)
+{
+  int all, one, pid, xstatus;
+
+  all = sched_getaffinity(0);
+  if(all <= 0){
+    printf("%s: sched_getaffinity failed\n", s);
+    exit(1);
+  }
+  one = all & -all;  // the lowest CPU
+  if(sched_setaffinity(0, 0) != -1){
+    printf("%s: sched_setaffinity accepted an empty mask\n", s);
+    exit(1);
+  }
+  if(sched_setaffinity(0, one) != 0 || sched_getaffinity(0) != one){
+    printf("%s: sched_setaffinity failed\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(int i = 0; i < 100; i++)
+      getpid();
+    exit(sched_getaffinity(0) == one ? 0 : 1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child did not inherit its affinity\n", s);
+    exit(1);
+  }
+
+  if(sched_setaffinity(0, all) != 0 || sched_getaffinity(0) != all){
+    printf("%s: cannot restore affinity\n", s);
+    exit(1);
+  }
+}
+
+#define GANGGAP  100000    // ns off the CPU that ends a run
+#define GANGNRUN 256
+
+// Spin from start to end, and send back the intervals this
+// process was running, as seen from the clock.
+static void
+ganglog(uint64 start, uint64 end, int fd)
+{
+  static uint64 run[GANGNRUN][2];
+  uint64 t, from, last;
+  int n;
+
+  while((t = clock_gettime()) < start)
+    ;
+  n = 0;
+  from = last = t;
+  while((t = clock_gettime()) < end){
+    if(t - last > GANGGAP && n < GANGNRUN - 1){
+      run[n][0] = from;
+      run[n][1] = last;
+      n++;
+      from = t;
+    }
+    last = t;
+  }
+  run[n][0] = from;
+  run[n][1] = last;
+  n++;
+  write(fd, &n, sizeof(n));
+  write(fd, run, n * sizeof(run[0]));
+}
+
+// Read back n intervals sent by ganglog().
+static int
+gangread(int fd, uint64 run[][2])
+{
+  int n, i, got;
+
+  if(read(fd, &n, sizeof(n)) != sizeof(n) || n < 1 || n > GANGNRUN)
+    return -1;
+  for(i = 0; i < n * sizeof(run[0]); i += got)
+    if((got = read(fd, (char*)run + i, n * sizeof(run[0]) - i)) <= 0)
+      return -1;
+  return n;
+}
+
+// two gang members should mostly run at the same time, even
+// with the CPUs busy with other processes, which would leave
+// independent processes running together only by chance.
+void
+gang(char *s)
+{
+  static uint64 run[2][GANGNRUN][2];
+  int pids[2], fds[2][2], n[2], xstatus, c, i, j, ncpu, nhog, old;
+  uint64 start, end, lo, hi, mine, both;
+
+  if(setgang(0, -1) != -1){
+    printf("%s: setgang accepted a negative gang\n", s);
+    exit(1);
+  }
+  ncpu = 0;
+  for(i = sched_getaffinity(0); i; i &= i - 1)
+    ncpu++;
+  if(ncpu < 2)
+    return;
+  old = sched_setquantum(SCHED_FAIR, 10);
+
+  // keep every CPU busy with two spinners; they stop by themselves.
+  start = clock_gettime() + 50000000;
+  end = start + 200000000;
+  nhog = 2 * ncpu;
+  for(c = 0; c < nhog; c++){
+    if((pids[0] = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[0] == 0){
+      while(clock_gettime() < end + 100000000)
+        ;
+      exit(0);
+    }
+  }
+
+  for(c = 0; c < 2; c++){
+    if(pipe(fds[c]) < 0 || (pids[c] = fork()) < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[c] == 0){
+      close(fds[c][0]);
+      ganglog(start, end, fds[c][1]);
+      exit(0);
+    }
+    close(fds[c][1]);
+    if(setgang(pids[c], 1234) != 0){
+      printf("%s: setgang failed\n", s);
+      exit(1);
+    }
+  }
+  for(c = 0; c < 2; c++){
+    if((n[c] = gangread(fds[c][0], run[c])) < 0){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+    close(fds[c][0]);
+  }
+  for(c = 0; c < nhog + 2; c++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  sched_setquantum(SCHED_FAIR, old);
+
+  mine = both = 0;
+  for(i = 0; i < n[0]; i++){
+    mine += run[0][i][1] - run[0][i][0];
+    for(j = 0; j < n[1]; j++){
+      lo = run[0][i][0] > run[1][j][0] ? run[0][i][0] : run[1][j][0];
+      hi = run[0][i][1] < run[1][j][1] ? run[0][i][1] : run[1][j][1];
+      if(hi > lo)
+        both += hi - lo;
+    }
+  }
+  if(mine == 0 || both * 2 < mine){
+    printf("%s: gang ran together %l of %l ns\n", s, both, mine);
+    exit(1);
+  }
+  if(setgang(pids[0], 0) != -1){
+    printf("%s: setgang on a dead process\n", s);
+    exit(1);
+  }
+}
+
+// pid lookups find live processes, including the caller,
+// and nothing once a process has been reaped.
+void
+pidlookup(char *s)
+{
+  static char page[PGSIZE];
+  uint64 va;
+  int pid;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(0);
+  wait(0);
+  if(kill(pid) != -1 || setpriority(pid, 0, 0) != -1 ||
+     map_shared_pages(pid, getpid(), (uint64)page, PGSIZE) != -1 ||
+     unmap_shared_pages(pid, 0, PGSIZE) != -1){
+    printf("%s: found reaped pid %d\n", s, pid);
+    exit(1);
+  }
+
+  page[0] = 'x';
+  va = map_shared_pages(getpid(), getpid(), (uint64)page, PGSIZE);
+  if(va == -1){
+    printf("%s: cannot share a page with itself\n", s);
+    exit(1);
+  }
+  if(*(char*)va != 'x' || unmap_shared_pages(getpid(), va, PGSIZE) != 0){
+    printf("%s: bad self mapping\n", s);
+    exit(1);
+  }
+}
+
+// nanosleep() sleeps at least as long as asked, and short
+// sleeps do not wait for a whole clock tick.
+void
+nanosleeptest(char *s)
+{
+  uint64 t0, t1;
+  int i;
+
+  t0 = clock_gettime();
+  if(nanosleep(5000000) < 0){
+    printf("%s: nanosleep failed\n", s);
+    exit(1);
+  }
+  t1 = clock_gettime();
+  if(t1 - t0 < 5000000){
+    printf("%s: woke after %l ns, not 5000000\n", s, t1 - t0);
+    exit(1);
+  }
+
+  // 20 sleeps of 1 ms would take 2 seconds at tick resolution.
+  t0 = clock_gettime();
+  for(i = 0; i < 20; i++)
+    nanosleep(1000000);
+  t1 = clock_gettime();
+  if(t1 - t0 < 20000000 || t1 - t0 > 1000000000){
+    printf("%s: 20 1ms sleeps took %l ns\n", s, t1 - t0);
+    exit(1);
+  }
+}
+
+// two CPU-bound processes sharing one CPU take turns, even
+// though the first had the CPU to itself, and so no time
+// slice, when the second arrived.
+void
+timeslice(char *s)
+{
+  int pids[2], xstatus, one, old, c, gaps;
+  uint64 t0, t, last;
+
+  if(sched_setquantum(SCHED_FIFO, 10) != -1){
+    printf("%s: SCHED_FIFO has a time slice\n", s);
+    exit(1);
+  }
+  old = sched_setquantum(SCHED_FAIR, 10);
+  if(old <= 0){
+    printf("%s: sched_setquantum failed\n", s);
+    exit(1);
+  }
+  one = sched_getaffinity(0);
+  one &= -one;
+
+  for(c = 0; c < 2; c++){
+    pids[c] = fork();
+    if(pids[c] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[c] == 0){
+      sched_setaffinity(0, one);
+      // Count the times this process was kept off the CPU.
+      gaps = 0;
+      t0 = last = clock_gettime();
+      while((t = clock_gettime()) - t0 < 500000000){
+        if(t - last > 5000000)
+          gaps++;
+        last = t;
+      }
+      exit(gaps > 0 ? 0 : 1);
+    }
+  }
+  for(c = 0; c < 2; c++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: a process was never preempted\n", s);
+      sched_setquantum(SCHED_FAIR, old);
+      exit(1);
+    }
+  }
+  sched_setquantum(SCHED_FAIR, old);
+}
+
+// kill() should stop a process that spins alone, without
+// system calls, on a CPU that takes no timer interrupts.
+void
+killspin(char *s)
+{
+  int pid, xstatus, old, cpu;
+
+  old = sched_getaffinity(0);
+  if((old & ~1) == 0)
+    return;
+  cpu = old & ~1;
+  cpu &= -cpu;
+  // keep ourselves on CPU 0, so the child is alone on its CPU.
+  if(sched_setaffinity(0, 1) != 0){
+    printf("%s: sched_setaffinity failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sched_setaffinity(0, cpu);
+    for(;;)
+      ;
+  }
+  sleep(2);
+  kill(pid);
+  wait(&xstatus);
+  sched_setaffinity(0, old);
+  if(xstatus != -1){
+    printf("%s: spinning child exited with %d\n", s, xstatus);
+    exit(1);
+  }
+}
+
+// sched_setaffinity() should move a process that spins alone,
+// without system calls, on a CPU that takes no timer interrupts.
+// It is moved onto CPU 0, next to another spinner, and so must
+// start being kept off the CPU at times.
+void
+affinitymove(char *s)
+{
+  int pids[2], xstatus, all, cpu, old, c, gaps;
+  uint64 t0, move, t, last;
+
+  all = sched_getaffinity(0);
+  if((all & ~1) == 0)
+    return;
+  cpu = all & ~1;
+  cpu &= -cpu;
+  // keep ourselves on CPU 0, so the first child is alone on its CPU.
+  if(sched_setaffinity(0, 1) != 0){
+    printf("%s: sched_setaffinity failed\n", s);
+    exit(1);
+  }
+  old = sched_setquantum(SCHED_FAIR, 10);
+
+  t0 = clock_gettime();
+  move = t0 + 100000000;
+  for(c = 0; c < 2; c++){
+    pids[c] = fork();
+    if(pids[c] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[c] == 0){
+      sched_setaffinity(0, c == 0 ? cpu : 1);
+      // Count the times this process was kept off the CPU
+      // after the move.
+      gaps = 0;
+      last = clock_gettime();
+      while((t = clock_gettime()) - t0 < 600000000){
+        if(t - last > 5000000 && t > move)
+          gaps++;
+        last = t;
+      }
+      exit(c == 1 || gaps > 0 ? 0 : 1);
+    }
+  }
+  while(clock_gettime() < move)
+    sleep(1);
+  if(sched_setaffinity(pids[0], 1) != 0 || sched_getaffinity(pids[0]) != 1){
+    printf("%s: sched_setaffinity of a child failed\n", s);
+    exit(1);
+  }
+  for(c = 0; c < 2; c++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: the spinning child did not move\n", s);
+      sched_setquantum(SCHED_FAIR, old);
+      exit(1);
+    }
+  }
+  sched_setquantum(SCHED_FAIR, old);
+  sched_setaffinity(0, all);
+}
+
+// the profiler should sample a process that spins in user space.
+void
+proftest(char *s)
+{
+  struct profsample buf[16];
+  int fd, n, i, mine;
+  uint64 t0;
+
+  if((fd = open("/prof", O_RDWR)) < 0){
+    mknod("/prof", PROF, 0);
+    fd = open("/prof", O_RDWR);
+  }
+  if(fd < 0 || write(fd, "1", 1) != 1){
+    printf("%s: cannot start profiling\n", s);
+    exit(1);
+  }
+  t0 = clock_gettime();
+  while(clock_gettime() - t0 < 100000000)
+    ;
+  if(write(fd, "0", 1) != 1){
+    printf("%s: cannot stop profiling\n", s);
+    exit(1);
+  }
+
+  mine = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    for(i = 0; i < n / sizeof(buf[0]); i++){
+      if(buf[i].cpu >= NCPU || buf[i].depth < 1 || buf[i].depth > PROFDEPTH){
+        printf("%s: bad sample\n", s);
+        exit(1);
+      }
+      if(buf[i].pid == getpid() && buf[i].user)
+        mine++;
+    }
+  }
+  close(fd);
+  if(n < 0 || mine == 0){
+    printf("%s: no samples of the spinning process\n", s);
+    exit(1);
+  }
+}
+
+// sysstat() should count each system call, for the process
+// and for the whole system.
+void
+sysstattest(char *s)
+{
+  static struct sysstat before[NSYSCALL], after[NSYSCALL], all[NSYSCALL];
+  uint64 n;
+  int i;
+
+  if(sysstat(getpid(), before, NSYSCALL) != NSYSCALL){
+    printf("%s: sysstat failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 10; i++)
+    getpid();
+  if(sysstat(getpid(), after, NSYSCALL) != NSYSCALL ||
+     sysstat(0, all, NSYSCALL) != NSYSCALL){
+    printf("%s: sysstat failed\n", s);
+    exit(1);
+  }
+  // the getpid() in the second call counts too.
+  if(after[SYS_getpid].ncall - before[SYS_getpid].ncall != 11){
+    printf("%s: wrong getpid count\n", s);
+    exit(1);
+  }
+  if(after[SYS_sysstat].ncall - before[SYS_sysstat].ncall != 1){
+    printf("%s: wrong sysstat count\n", s);
+    exit(1);
+  }
+  n = 0;
+  for(i = 0; i < NSYSHIST; i++)
+    n += after[SYS_getpid].hist[i] - before[SYS_getpid].hist[i];
+  if(n != 11 || after[SYS_getpid].maxcycles == 0){
+    printf("%s: wrong getpid histogram\n", s);
+    exit(1);
+  }
+  n = 0;
+  for(i = 0; i < NSYSHIST; i++)
+    n += all[SYS_getpid].hist[i];
+  if(all[SYS_getpid].ncall < 11 || n == 0){
+    printf("%s: wrong system-wide getpid count\n", s);
+    exit(1);
+  }
+  if(sysstat(-1, all, NSYSCALL) != -1){
+    printf("%s: sysstat of no process succeeded\n", s);
+    exit(1);
+  }
+}
+
+// the trace device should record this process's system calls,
+// with each CPU's events in time order.
+void
+tracetest(char *s)
+{
+  static struct traceevent buf[64];
+  uint64 last[NCPU];
+  int fd, n, i, mine;
+
+  if((fd = open("/trace", O_RDWR)) < 0){
+    mknod("/trace", TRACE, 0);
+    fd = open("/trace", O_RDWR);
+  }
+  if(fd < 0 || write(fd, "1", 1) != 1){
+    printf("%s: cannot start tracing\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 10; i++)
+    getpid();
+  if(write(fd, "0", 1) != 1){
+    printf("%s: cannot stop tracing\n", s);
+    exit(1);
+  }
+
+  memset(last, 0, sizeof(last));
+  mine = 0;
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    for(i = 0; i < n / sizeof(buf[0]); i++){
+      if(buf[i].cpu >= NCPU || buf[i].time < last[buf[i].cpu]){
+        printf("%s: bad event\n", s);
+        exit(1);
+      }
+      last[buf[i].cpu] = buf[i].time;
+      if(buf[i].type == TR_SYSCALL && buf[i].arg == SYS_getpid &&
+         buf[i].pid == getpid())
+        mine++;
+    }
+  }
+  close(fd);
+  if(n < 0 || mine < 10){
+    printf("%s: missing getpid events\n", s);
+    exit(1);
+  }
+}
+
 // allocate all mem, free it, and allocate again
 void
 mem(char *s)
@@ -1145,6 +1746,82 @@ sharedfd(char *s)
   }
 }
 
+// several processes read the same file at once, through
+// their own file descriptors (sharing the inode lock) and
+// through one inherited descriptor (sharing the offset).
+void
+sharedread(char *s)
+{
+  enum { NCHILD = 4, N = 3*BSIZE, SZ = 128 };
+  int fd, sfd, i, c, n, pid, xstatus, tot;
+  char rbuf[SZ];
+
+  unlink("sharedread");
+  fd = open("sharedread", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create sharedread\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++)
+    buf[i] = i % 251;
+  if(write(fd, buf, N) != N){
+    printf("%s: write sharedread failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  sfd = open("sharedread", 0);
+  if(sfd < 0){
+    printf("%s: cannot open sharedread\n", s);
+    exit(1);
+  }
+  for(c = 0; c < NCHILD; c++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      // children exit with a count, so fail with -1.
+      fd = open("sharedread", 0);
+      if(fd < 0){
+        printf("%s: cannot open sharedread\n", s);
+        exit(-1);
+      }
+      for(i = 0; (n = read(fd, rbuf, SZ)) > 0; i += n){
+        if(memcmp(rbuf, buf + i, n) != 0){
+          printf("%s: wrong data at %d\n", s, i);
+          exit(-1);
+        }
+      }
+      close(fd);
+      if(i != N){
+        printf("%s: read %d bytes, not %d\n", s, i, N);
+        exit(-1);
+      }
+      // count what this process gets from the shared offset.
+      tot = 0;
+      while((n = read(sfd, rbuf, SZ)) > 0)
+        tot += n;
+      exit(tot / SZ);
+    }
+  }
+  close(sfd);
+
+  tot = 0;
+  for(c = 0; c < NCHILD; c++){
+    wait(&xstatus);
+    if(xstatus < 0)
+      exit(1);
+    tot += xstatus;
+  }
+  unlink("sharedread");
+  if(tot != N / SZ){
+    printf("%s: shared offset read %d pieces, not %d\n", s, tot, N / SZ);
+    exit(1);
+  }
+}
+
 // four processes write different files at the same
 // time, to test block allocation.
 void
@@ -1778,6 +2455,180 @@ bigfile(char *s)
   unlink("bigfile.dat");
 }
 
+// file data is written back, and its blocks allocated, only
+// some time after write() returns. check that it reads back the
+// same before and after that, and that quickly deleted files
+// do not leak the blocks they never got.
+void
+delaywrite(char *s)
+{
+  enum { NB = 4, NTEMP = 100 };
+  int fd, i, pass;
+
+  unlink("delay.dat");
+  fd = open("delay.dat", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create delay.dat\n", s);
+    exit(1);
+  }
+  memset(buf, 'a', NB*BSIZE);
+  if(write(fd, buf, NB*BSIZE) != NB*BSIZE){
+    printf("%s: write delay.dat failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // rewrite the first two blocks.
+  fd = open("delay.dat", O_RDWR);
+  memset(buf, 'b', 2*BSIZE);
+  if(fd < 0 || write(fd, buf, 2*BSIZE) != 2*BSIZE){
+    printf("%s: rewrite delay.dat failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for(pass = 0; pass < 2; pass++){
+    fd = open("delay.dat", 0);
+    if(fd < 0){
+      printf("%s: cannot open delay.dat\n", s);
+      exit(1);
+    }
+    memset(buf, 0, NB*BSIZE);
+    if(read(fd, buf, NB*BSIZE + 1) != NB*BSIZE){
+      printf("%s: read delay.dat wrong size\n", s);
+      exit(1);
+    }
+    close(fd);
+    for(i = 0; i < NB*BSIZE; i++){
+      if(buf[i] != (i < 2*BSIZE ? 'b' : 'a')){
+        printf("%s: wrong data at %d, pass %d\n", s, i, pass);
+        exit(1);
+      }
+    }
+    sleep(50);  // let the flusher write it out
+  }
+  unlink("delay.dat");
+
+  for(i = 0; i < NTEMP; i++){
+    fd = open("delay.tmp", O_CREATE | O_RDWR);
+    if(fd < 0 || write(fd, buf, 2*BSIZE) != 2*BSIZE){
+      printf("%s: write delay.tmp failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    unlink("delay.tmp");
+  }
+}
+
+// small files and directories live in the inode until they
+// outgrow it; check that content survives the move to a block.
+void
+inlinefile(char *s)
+{
+  enum { N = 200 };
+  char name[3];
+  int fd, i;
+
+  unlink("inline.dat");
+  fd = open("inline.dat", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create inline.dat\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++)
+    buf[i] = 'a' + i % 26;
+  for(i = 0; i < N; i += 10){
+    if(write(fd, buf + i, 10) != 10){
+      printf("%s: write inline.dat failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open("inline.dat", 0);
+  if(fd < 0){
+    printf("%s: cannot open inline.dat\n", s);
+    exit(1);
+  }
+  memset(buf, 0, N);
+  if(read(fd, buf, N + 1) != N){
+    printf("%s: read inline.dat wrong size\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    if(buf[i] != 'a' + i % 26){
+      printf("%s: read inline.dat wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("inline.dat");
+
+  if(mkdir("inlined") != 0){
+    printf("%s: mkdir inlined failed\n", s);
+    exit(1);
+  }
+  if(chdir("inlined") != 0){
+    printf("%s: chdir inlined failed\n", s);
+    exit(1);
+  }
+  name[1] = 'x';
+  name[2] = '\0';
+  for(i = 0; i < 20; i++){
+    name[0] = 'a' + i;
+    if((fd = open(name, O_CREATE)) < 0){
+      printf("%s: create inlined/%s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+  for(i = 0; i < 20; i++){
+    name[0] = 'a' + i;
+    if(unlink(name) != 0){
+      printf("%s: unlink inlined/%s failed\n", s, name);
+      exit(1);
+    }
+  }
+  chdir("..");
+  if(unlink("inlined") != 0){
+    printf("%s: unlink inlined failed\n", s);
+    exit(1);
+  }
+}
+
+// content that was inline is on disk already; when the file
+// outgrows the inode, the size on disk must keep covering it
+// rather than wait for delayed write-back.
+void
+inlinegrow(char *s)
+{
+  struct stat st;
+  int fd;
+
+  unlink("grow.dat");
+  fd = open("grow.dat", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf("%s: cannot create grow.dat\n", s);
+    exit(1);
+  }
+  memset(buf, 'g', 3*NINLINE);
+  if(write(fd, buf, NINLINE/2) != NINLINE/2 || fstat(fd, &st) < 0 ||
+     st.disksize != NINLINE/2){
+    printf("%s: inline size not on disk\n", s);
+    exit(1);
+  }
+  if(write(fd, buf, 2*NINLINE) != 2*NINLINE || fstat(fd, &st) < 0){
+    printf("%s: write grow.dat failed\n", s);
+    exit(1);
+  }
+  if(st.size != NINLINE/2 + 2*NINLINE || st.disksize != st.size){
+    printf("%s: size on disk %l, not %l\n", s, st.disksize, st.size);
+    exit(1);
+  }
+  close(fd);
+  unlink("grow.dat");
+}
+
 void
 fourteen(char *s)
 {
@@ -1953,6 +2804,75 @@ iref(char *s)
   chdir("/");
 }
 
+// hold open many more inodes than the inode table starts
+// out with, so that it has to grow. each child already has
+// five descriptors open (stdio and the two pipe ends), so
+// NF must leave it within NOFILE.
+void
+manyinodes(char *s)
+{
+  enum { NCHILD = 8, NF = 11 };
+  int c, i, pid, xstatus, ready[2], go[2];
+  char name[8], ch;
+
+  if(pipe(ready) < 0 || pipe(go) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  name[0] = 'm';
+  name[1] = 'i';
+  name[4] = '\0';
+  for(c = 0; c < NCHILD; c++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(go[1]);
+      name[2] = 'a' + c;
+      for(i = 0; i < NF; i++){
+        name[3] = 'a' + i;
+        if(open(name, O_CREATE|O_RDWR) < 0){
+          printf("%s: create %s failed\n", s, name);
+          write(ready[1], "f", 1);
+          exit(1);
+        }
+      }
+      write(ready[1], "x", 1);
+      read(go[0], &ch, 1);  // returns once the parent closes go[1]
+      exit(0);
+    }
+  }
+  close(ready[1]);
+  close(go[0]);
+
+  // all children now hold their files open at once.
+  for(c = 0; c < NCHILD; c++){
+    if(read(ready[0], &ch, 1) != 1){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+  }
+  close(go[1]);
+  close(ready[0]);
+
+  for(c = 0; c < NCHILD; c++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+
+  for(c = 0; c < NCHILD; c++){
+    name[2] = 'a' + c;
+    for(i = 0; i < NF; i++){
+      name[3] = 'a' + i;
+      unlink(name);
+    }
+  }
+}
+
 // test that fork fails gracefully
 // the forktest binary also does this, but it runs out of proc entries first.
 // inside the bigger usertests binary, we run out of memory first.
@@ -2602,8 +3522,20 @@ struct test {
   {forkfork, "forkfork"},
   {forkforkfork, "forkforkfork"},
   {reparent2, "reparent2"},
+  {schedprio, "schedprio"},
+  {affinity, "affinity"},
+  {gang, "gang"},
+  {pidlookup, "pidlookup"},
+  {nanosleeptest, "nanosleep"},
+  {timeslice, "timeslice"},
+  {killspin, "killspin"},
+  {affinitymove, "affinitymove"},
+  {proftest, "prof"},
+  {sysstattest, "sysstat"},
+  {tracetest, "trace"},
   {mem, "mem"},
   {sharedfd, "sharedfd"},
+  {sharedread, "sharedread"},
   {fourfiles, "fourfiles"},
   {createdelete, "createdelete"},
   {unlinkread, "unlinkread"},
@@ -2613,10 +3545,14 @@ struct test {
   {subdir, "subdir"},
   {bigwrite, "bigwrite"},
   {bigfile, "bigfile"},
+  {inlinefile, "inlinefile"},
+  {inlinegrow, "inlinegrow"},
+  {delaywrite, "delaywrite"},
   {fourteen, "fourteen"},
   {rmdot, "rmdot"},
   {dirfile, "dirfile"},
   {iref, "iref"},
+  {manyinodes, "manyinodes"},
   {forktest, "forktest"},
   {sbrkbasic, "sbrkbasic"},
   {sbrkmuch, "sbrkmuch"},
@@ -2837,7 +3773,6 @@ diskfull(char *s)
       break;
     }
     for(int i = 0; i < MAXFILE; i++){
-      char buf[BSIZE];
       if(write(fd, buf, BSIZE) != BSIZE){
         done = 1;
         close(fd);
@@ -38,4 +38,13 @@ entry("sleep");
 entry("uptime");
 entry("map_shared_pages");
 entry("unmap_shared_pages");
-entry("getppid");
\ No newline at end of file
+entry("getppid");
+entry("lockstat");
+entry("setpriority");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("setgang");
+entry("nanosleep");
+entry("clock_gettime");
+entry("sched_setquantum");
+entry("sysstat");